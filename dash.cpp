@@ -70,7 +70,9 @@ void CmdPrompt(string &cmd)
     
     cout << "dash> ";
 
-    getline(cin, cmd);
+    //End of input ends the shell
+    if(!getline(cin, cmd))
+      cmd = "exit";
     
   }while((cmd == " ") || (cmd == "") || (cmd == "\t"));
 
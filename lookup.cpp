@@ -0,0 +1,199 @@
+/***************************************************************************//**
+ * File:
+ * lookup.cpp
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Contains implementation of the resident page search kernels.
+ ******************************************************************************/
+
+#include "lookup.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOOKUP_X86
+#include <immintrin.h>
+#endif
+
+/***************************************************************************//**
+ * lookup_scalar
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Searches the keys one at a time. Used where no vector kernel is available.
+ *
+ * Parameters:
+ * keys - The keys to search, padded to a multiple of LOOKUP_BLOCK.
+ * count - Number of keys, including padding.
+ * key - The key to look for.
+ *
+ * Returns:
+ * Index of the first matching key, or count if there is none.
+ ******************************************************************************/
+unsigned int lookup_scalar(const int* keys, unsigned int count, int key)
+{
+  unsigned int i;
+  
+  for (i = 0; i < count; i++)
+  {
+    if (keys[i] == key)
+      break;
+  }
+  
+  return i;
+}
+
+#ifdef LOOKUP_X86
+
+/***************************************************************************//**
+ * lookup_sse41
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Searches the keys eight at a time with two four-wide SSE comparisons, using
+ * a single SSE4.1 test to skip blocks without a match.
+ *
+ * Parameters:
+ * keys - The keys to search, padded to a multiple of LOOKUP_BLOCK.
+ * count - Number of keys, including padding.
+ * key - The key to look for.
+ *
+ * Returns:
+ * Index of the first matching key, or count if there is none.
+ ******************************************************************************/
+__attribute__((target("sse4.1")))
+unsigned int lookup_sse41(const int* keys, unsigned int count, int key)
+{
+  __m128i needle = _mm_set1_epi32(key);
+  __m128i low;
+  __m128i high;
+  __m128i any;
+  unsigned int mask;
+  unsigned int i;
+  
+  for (i = 0; i < count; i += 8)
+  {
+    low = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (keys + i)),
+                          needle);
+    high = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (keys + i + 4)),
+                           needle);
+    any = _mm_or_si128(low, high);
+    if (!_mm_testz_si128(any, any))
+    {
+      mask = _mm_movemask_ps(_mm_castsi128_ps(low))
+             | _mm_movemask_ps(_mm_castsi128_ps(high)) << 4;
+      return i + __builtin_ctz(mask);
+    }
+  }
+  
+  return count;
+}
+
+/***************************************************************************//**
+ * lookup_avx2
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Searches the keys sixteen at a time with two eight-wide AVX2 comparisons.
+ *
+ * Parameters:
+ * keys - The keys to search, padded to a multiple of LOOKUP_BLOCK.
+ * count - Number of keys, including padding.
+ * key - The key to look for.
+ *
+ * Returns:
+ * Index of the first matching key, or count if there is none.
+ ******************************************************************************/
+__attribute__((target("avx2")))
+unsigned int lookup_avx2(const int* keys, unsigned int count, int key)
+{
+  __m256i needle = _mm256_set1_epi32(key);
+  __m256i low;
+  __m256i high;
+  unsigned int mask;
+  unsigned int i;
+  
+  for (i = 0; i < count; i += 16)
+  {
+    low = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (keys + i)),
+                             needle);
+    high = _mm256_cmpeq_epi32(
+             _mm256_loadu_si256((const __m256i*) (keys + i + 8)), needle);
+    mask = _mm256_movemask_ps(_mm256_castsi256_ps(low))
+           | _mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8;
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  
+  return count;
+}
+
+#else
+
+// Without x86 vector units every kernel is the scalar one
+unsigned int lookup_sse41(const int* keys, unsigned int count, int key)
+{
+  return lookup_scalar(keys, count, key);
+}
+
+unsigned int lookup_avx2(const int* keys, unsigned int count, int key)
+{
+  return lookup_scalar(keys, count, key);
+}
+
+#endif
+
+/***************************************************************************//**
+ * lookup_supported
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Checks whether this processor can run a kernel.
+ *
+ * Parameters:
+ * kernel - The kernel to check.
+ *
+ * Returns:
+ * True if the kernel can be called.
+ ******************************************************************************/
+bool lookup_supported(lookup_kernel kernel)
+{
+#ifdef LOOKUP_X86
+  __builtin_cpu_init();
+  if (kernel == lookup_avx2)
+    return __builtin_cpu_supports("avx2");
+  if (kernel == lookup_sse41)
+    return __builtin_cpu_supports("sse4.1");
+#endif
+  return kernel == lookup_scalar;
+}
+
+/***************************************************************************//**
+ * lookup_select
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Picks the widest kernel this processor supports.
+ *
+ * Returns:
+ * The kernel to use.
+ ******************************************************************************/
+lookup_kernel lookup_select()
+{
+  if (lookup_supported(lookup_avx2))
+    return lookup_avx2;
+  if (lookup_supported(lookup_sse41))
+    return lookup_sse41;
+  return lookup_scalar;
+}
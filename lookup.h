@@ -0,0 +1,36 @@
+/***************************************************************************//**
+ * File:
+ * lookup.h
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Contains the kernels that search a small array of resident pages for a page
+ * id. Each kernel compares the id against many frames at once where the
+ * processor allows it, and the best one the processor supports is chosen at
+ * run time.
+ ******************************************************************************/
+
+#ifndef _LOOKUP_H_
+#define _LOOKUP_H_
+
+// Key arrays passed to a kernel are padded to a multiple of this many entries
+#define LOOKUP_BLOCK 16
+
+/*******************************************************************************
+ * A search kernel. It is given count keys, count being a multiple of
+ * LOOKUP_BLOCK, and returns the index of the first one equal to key, or count
+ * if there is none.
+ ******************************************************************************/
+typedef unsigned int (*lookup_kernel)(const int* keys, unsigned int count,
+  int key);
+
+unsigned int lookup_scalar(const int* keys, unsigned int count, int key);
+unsigned int lookup_sse41(const int* keys, unsigned int count, int key);
+unsigned int lookup_avx2(const int* keys, unsigned int count, int key);
+
+bool lookup_supported(lookup_kernel kernel);
+lookup_kernel lookup_select();
+
+#endif
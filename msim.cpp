@@ -10,6 +10,16 @@
  ******************************************************************************/
  
  #include "msim.h"
+#include "pool.h"
+#include <thread>
+#include <queue>
+
+// Every page replacement policy, in the order they are listed to users
+const int MSIM_POLICIES[] =
+  { MSIM_FIFO, MSIM_OPT, MSIM_LRU, MSIM_LFU, MSIM_MFU, MSIM_SC, MSIM_C,
+    MSIM_ESC, MSIM_ARC, MSIM_CAR, MSIM_LIRS, MSIM_CLOCKPRO, MSIM_TINYLFU };
+const unsigned int MSIM_NUM_POLICIES =
+  sizeof(MSIM_POLICIES) / sizeof(MSIM_POLICIES[0]);
 
 /***************************************************************************//**
  * msim
@@ -19,7 +29,9 @@
  * 
  * Description:
  * Entry function for the msim command. Parses arguments and distributes control
- * to relevant functions. Also performs file handling.
+ * to relevant functions. Also performs file handling, accepting either text
+ * traces or binary traces made with "msim convert", or text traces of virtual
+ * addresses when given a page size.
  *
  * Parameters:
  * argc - Number of arguments supplied to function
@@ -31,929 +43,2294 @@
  ******************************************************************************/
 int msim(int argc, char*argv[])
 {
-  ifstream fin;
-  vector<int> ref_string;
-  int reference;
+  trace ref_string;
+  vector<int> values;
+  vector<char> writes;
+  vector<int> records;
+  unsigned int fields;
   int alg;
-  int num_frames;
+  int i;
+  msim_output out;
+  policy_config config;
+  unsigned int frames[3] = { 0, 0, 1 };   // first, last, step of frame counts
+  uint64_t page_size = 0;               // nonzero for address traces
+  double rate = MSIM_SHARDS_RATE;       // fraction of pages shards samples
+  unsigned long long interval = MSIM_STREAM_INTERVAL;
+  bool stream = false;
+  bool processes = false;
+  int sharing = MSIM_GLOBAL;
+  trace_stream input;
+  unsigned int sample_pages = 0;        // nonzero to sample a fixed number
+  unsigned int tlb_entries = 0;         // nonzero to simulate the hierarchy
+  unsigned int tlb_ways = MSIM_TLB_WAYS;
+  double times[3] = { MSIM_TLB_TIME, MSIM_MEMORY_TIME, MSIM_SWAP_TIME };
+  bool range;
+  vector<int> algs;
+  char* name;
+  ofstream fout;
 
   // Display help if no arguments are received
   if (argc < 4)
   {
-    cout << "Usage:\n\tmsim <file> <frames> <fifo|opt|lru|lfu|mfu|sc|c>" << endl;
+    cout << "Usage:\n\tmsim <file> <frames>"
+         << " <fifo|opt|lru|lfu|mfu|sc|c|esc|arc|car|lirs|cpro|tinylfu|mrc|all>"
+         << "\n\t     [options]\n"
+         << "\tmsim <file> <first>:<last>[:<step>] <alg[,alg...]|all>"
+         << " [options]\n"
+         << "\tmsim <file> [<first>:]<last>[:<step>] belady\n"
+         << "\tmsim <file> <tau>[:<last>[:<step>]] ws\n"
+         << "\tmsim <file> <threshold>[:<last>[:<step>]] pff\n"
+         << "\tmsim <file|-> [<first>:]<last>[:<step>] shards\n"
+         << "\tmsim <file|-> <frames> <fifo|lru|lfu|mfu|sc|c|esc> --stream"
+         << " [options]\n"
+         << "\tmsim convert <text file> <binary file>\n"
+         << "\tmsim bench <pages> <lookups>\n"
+         << "Options:\n"
+         << "\t--quiet         only print the summary\n"
+         << "\t--sample <n>    print every nth reference\n"
+         << "\t--out <file>    write sweep results to a CSV file\n"
+         << "\t--decay <n>     halve lfu/mfu counts every n references\n"
+         << "\t--window <n>    keep opt's lookahead in a temporary file,"
+         << " n references\n\t                in memory at a time; binary"
+         << " traces only\n"
+         << "\t--page-size <n> read the file as hex (0x) or decimal addresses"
+         << " in pages of n bytes\n"
+         << "\t--pids          read entries as pid:page and replace pages"
+         << " globally\n"
+         << "\t--local <fixed|proportional>\n\t                replace"
+         << " within per-process frame allocations\n"
+         << "\t--stream        simulate the trace as it is read; pipes and -"
+         << " (standard input)\n\t                are always streamed\n"
+         << "\t--interval <n>  report every n references of a stream,"
+         << " 0 for totals only\n"
+         << "\t--rate <r>      sample a fraction r of the pages for shards\n"
+         << "\t--sample-pages <n> sample at most n pages for shards\n"
+         << "\t--tlb <entries>[:<ways>]\n\t                look pages up"
+         << " through a TLB and report the hits at\n\t                each"
+         << " level of the memory hierarchy\n"
+         << "\t--times <tlb>:<memory>:<swap>\n\t                access times"
+         << " in ns for the effective access time\n"
+         << "Trace entries may end in r or w, as in 12w, to mark reads and"
+         << " writes and count write-backs of dirty pages\n"
+         << "A trace of - is read from standard input up to a line holding"
+         << " only " << TRACE_STREAM_END << ", after which\nthe shell reads"
+         << " commands again"
+         << endl;
     return 0;
   }
   
-  // Attempt to open file
-  fin.open(argv[1]);
-  if (!fin)
-  {
-    cout << "Failed to open " << argv[1] << " for input" << endl;
-    return 1;
-  }
-  
-  // Parse memory sizes
-  num_frames = (int) strtol(argv[2], NULL, 10);
-  
-  // Make sure number of frames is positive integer
-  if (num_frames < 1)
-  {
-    cout << "Invalid number of frames " << num_frames;
-    cout << ": expected positive integer" << endl;
-    return 1;
-  }
-  
-  // Parse algorithm argument
-  if (strcmp(argv[3], "fifo") == 0)
-    alg = 0;
-  else if (strcmp(argv[3], "opt") == 0)
-    alg = 1;
-  else if (strcmp(argv[3], "lru") == 0)
-    alg = 2;
-  else if (strcmp(argv[3], "lfu") == 0)
-    alg = 3;
-  else if (strcmp(argv[3], "mfu") == 0)
-    alg = 6;
-  else if (strcmp(argv[3], "sc") == 0)
-    alg = 4;
-  else if (strcmp(argv[3], "c") == 0)
-    alg = 5;
-  else
-  {
-    cout << "Unknown page replacement algorithm " << argv[2] << endl;
-    alg = -1;
-    return 1;
-  }
-  
-  // Read in values from file
-  while (fin >> reference)
+  // Convert a text trace to a binary one
+  if (strcmp(argv[1], "convert") == 0)
   {
-    ref_string.push_back(reference);
-  }
-
-  // Call appropriate algorithm function
-  switch (alg)
-  {
-  case 0:
-    msim_fifo(ref_string, (unsigned int) num_frames);
-    break;
-    
-  case 1:
-    msim_opt(ref_string, (unsigned int) num_frames);
-    break;
-    
-  case 2:
-    msim_lru(ref_string, (unsigned int) num_frames);
-    break;
-    
-  case 3:
-    msim_lfu(ref_string, (unsigned int) num_frames);
-    break;
-    
-  case 4:
-    msim_sc(ref_string, (unsigned int) num_frames);
-    break;
-    
-  case 5:
-    msim_c(ref_string, (unsigned int) num_frames);
-    break;
+    if (!trace_load(argv[2], values, &writes))
+    {
+      cout << "Failed to open " << argv[2] << " for input" << endl;
+      return 1;
+    }
     
-  case 6:
-    msim_mfu(ref_string, (unsigned int) num_frames);
-    break;
-  }
-
-  return 0;
-}
-
-/***************************************************************************//**
- * msim_fifo
- *
- * Author:
- * Daniel Andrus
- * 
- * Description:
- * Function to simulate a "first in first out" page management algorithm. Using
- * a supplied reference string in the form of an integer vector and a maximum
- * number of frames available to the system, this function displays the state of
- * the memory frames at each stage of the simulation, highlighting where page
- * faults occur and keeping a running total of the number of page faults that
- * occur.
- *
- * Parameters:
- * ref_string - vector of integers supplied in the order in which the pages are
- * accessed by the system.
- * num_frames - Maximum number of frames available to the simulation.
- ******************************************************************************/
-void msim_fifo(vector<int>& ref_string, unsigned int num_frames)
-{
-  vector<int> frames;
-  auto frame = frames.end();
-  bool fault;
-  int faults = 0;
-  int padding = 0;
-  int temp;
-  unsigned int i;
-  unsigned int j;
-  
-  vector<int> queue;          // FIFO vector that drives the algorithm
-  
-  // For formatting reasons, find 'widest' number
-  for (i = 0; i < ref_string.size(); i++)
-  {
-    // Handle positive and negative numbers differently
-    if (ref_string[i] < 0)
+    // Write flags go in a second field of every record
+    fields = writes.empty() ? 1 : 2;
+    records.resize(values.size() * fields);
+    for (i = 0; i < (int) values.size(); i++)
     {
-      temp = (int) (ceil(log10(-ref_string[i] + 1))) + 1;
+      records[i * fields] = values[i];
+      if (fields == 2)
+        records[i * fields + 1] = writes[i];
     }
-    else
+    if (!trace_write(argv[3], TRACE_PAGES, records.data(), values.size(),
+                     fields))
     {
-      temp = (int) (ceil(log10(ref_string[i] + 1)));
+      cout << "Failed to write " << argv[3] << endl;
+      return 1;
     }
-    
-    if (temp > padding) padding = temp;
+    cout << "Converted " << values.size() << " references" << endl;
+    return 0;
   }
   
-  cout << right;
+  // Time the residency lookups against each other
+  if (strcmp(argv[1], "bench") == 0)
+  {
+    frames[0] = (unsigned int) strtoul(argv[2], NULL, 10);
+    frames[1] = (unsigned int) strtoul(argv[3], NULL, 10);
+    if (frames[0] < 1 || frames[1] < 1)
+    {
+      cout << "Invalid benchmark size: expected positive integers" << endl;
+      return 1;
+    }
+    msim_bench(frames[0], frames[1]);
+    return 0;
+  }
   
-  // Work through reference string
-  for (i = 0; i < ref_string.size(); i++)
+  // Parse options
+  for (i = 4; i < argc; i++)
   {
-    frame = find(queue.begin(), queue.end(), ref_string[i]);
-    fault = (frame == queue.end());
-    
-    // Check for page faults
-    if (fault)
+    if (strcmp(argv[i], "--quiet") == 0)
     {
-      // Handle page faults
-      faults++;
-        
-      // Check if we have spare space
-      if (frames.size() < num_frames)
+      out.sample = 0;
+    }
+    else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc)
+    {
+      out.sample = (unsigned int) strtoul(argv[++i], NULL, 10);
+      if (out.sample < 1)
       {
-        // We have plenty of space, just stick it in there (lennyface.jpg)
-        frames.push_back(ref_string[i]);
+        cout << "Invalid sample interval " << argv[i];
+        cout << ": expected positive integer" << endl;
+        return 1;
       }
-      else
+    }
+    else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+    {
+      fout.open(argv[++i]);
+      if (!fout)
       {
-        // Out of space, pop first item off queue and replace that frame
-        frame = find(frames.begin(), frames.end(), queue[0]);
-        *frame = ref_string[i];
-        
-        // Update queue
-        queue.erase(queue.begin());
+        cout << "Failed to open " << argv[i] << " for output" << endl;
+        return 1;
       }
-      queue.push_back(ref_string[i]);
     }
-    else
+    else if (strcmp(argv[i], "--decay") == 0 && i + 1 < argc)
     {
-      // There's no fault... WHAT MORE DO YOU WANT FROM ME?!?!
+      config.decay = (unsigned int) strtoul(argv[++i], NULL, 10);
     }
-    
-    // Output frame state
-    cout << setw(padding) << ref_string[i] << " -> ";
-    for (j = 0; j < num_frames; j++)
+    else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc)
     {
-      cout << "| ";
-      if (j < frames.size())
+      page_size = strtoull(argv[++i], NULL, 10);
+      if (page_size == 0 || (page_size & (page_size - 1)) != 0)
       {
-        cout << setw(padding) << frames[j] << " ";
+        cout << "Invalid page size " << argv[i];
+        cout << ": expected power of two" << endl;
+        return 1;
       }
-      else
+    }
+    else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc)
+    {
+      config.window = strtoull(argv[++i], NULL, 10);
+      if (config.window < 1)
       {
-        cout << setw(padding) << " " << " ";
+        cout << "Invalid window " << argv[i];
+        cout << ": expected positive integer" << endl;
+        return 1;
       }
     }
-    cout << "|";
-    if (fault)
+    else if (strcmp(argv[i], "--pids") == 0)
     {
-      cout << " FAULT";
+      processes = true;
     }
-    cout << endl;
-  }
-  
-  // Final output
-  cout << "\n";
-  cout << "page faults: " << faults << endl;
-}
-
-/***************************************************************************//**
- * msim_opt
- *
- * Author:
- * Daniel Andrus
- * 
- * Description:
- * Function to simulate the optimal (predictive) page management algorithm.
- * Using a supplied reference string in the form of an integer vector and a
- * maximum number of frames available to the system, this function displays the
- * state of the memory frames at each stage of the simulation, highlighting
- * where page faults occur and keeping a running total of the number of page
- * faults that occur.
- *
- * Parameters:
- * ref_string - vector of integers supplied in the order in which the pages are
- * accessed by the system.
- * num_frames - Maximum number of frames available to the simulation.
- ******************************************************************************/
-void msim_opt(vector<int>& ref_string, unsigned int num_frames)
-{
-  vector<int> frames;
-  auto frame = frames.end();
-  bool fault;
-  int faults = 0;
-  int padding = 0;
-  int temp;
-  unsigned int i;
-  unsigned int j;
-  
-  vector<int> unfound;        // used for searching for last used item
-  
-  // For formatting reasons, find 'widest' number
-  for (i = 0; i < ref_string.size(); i++)
-  {
-    // Handle positive and negative numbers differently
-    if (ref_string[i] < 0)
+    else if (strcmp(argv[i], "--local") == 0 && i + 1 < argc)
     {
-      temp = (int) (ceil(log10(-ref_string[i] + 1))) + 1;
+      processes = true;
+      i++;
+      if (strcmp(argv[i], "fixed") == 0)
+        sharing = MSIM_FIXED;
+      else if (strcmp(argv[i], "proportional") == 0)
+        sharing = MSIM_PROPORTIONAL;
+      else
+      {
+        cout << "Unknown frame allocation " << argv[i];
+        cout << ": expected fixed or proportional" << endl;
+        return 1;
+      }
     }
-    else
+    else if (strcmp(argv[i], "--stream") == 0)
     {
-      temp = (int) (ceil(log10(ref_string[i] + 1)));
+      stream = true;
     }
-    
-    if (temp > padding) padding = temp;
-  }
-  
-  cout << right;
-  
-  for (i = 0; i < ref_string.size(); i++)
-  {
-    frame = find(frames.begin(), frames.end(), ref_string[i]);
-    fault = (frame == frames.end());
-    
-    // Check for and handle page faults
-    if (fault)
+    else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
     {
-      // Increment counter
-      faults++;
-      
-      // Figure out how to add new frame to our frame space
-      if (frames.size() < num_frames)
+      interval = strtoull(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+    {
+      rate = strtod(argv[++i], NULL);
+      if (!(rate > 0.0 && rate <= 1.0))
       {
-        // We have room, just append to end of frame list
-        frames.push_back(ref_string[i]);
+        cout << "Invalid sampling rate " << argv[i];
+        cout << ": expected a fraction between 0 and 1" << endl;
+        return 1;
       }
-      else
+    }
+    else if (strcmp(argv[i], "--sample-pages") == 0 && i + 1 < argc)
+    {
+      sample_pages = (unsigned int) strtoul(argv[++i], NULL, 10);
+      if (sample_pages < 1)
       {
-        // We don't have room, so figure out who to replace
-        
-        // Build "unfound" list, remove items as they're found
-        unfound = frames;
-        
-        // If a loaded frame is found in reference string's future, try not to
-        // replace it. This is a greedy algorithm.
-        for (j = i + 1; j < ref_string.size() && unfound.size() > 1; j++)
-        {
-          frame = find(unfound.begin(), unfound.end(), ref_string[j]);
-          if (frame != unfound.end())
-          {
-            unfound.erase(frame);
-          }
-        }
-        
-        // Replace first item left in unfound array
-        frame = find(frames.begin(), frames.end(), unfound[0]);
-        *frame = ref_string[i];
+        cout << "Invalid sample size " << argv[i];
+        cout << ": expected positive integer" << endl;
+        return 1;
       }
     }
-    else
+    else if (strcmp(argv[i], "--tlb") == 0 && i + 1 < argc)
     {
-      // There's no fault... WHAT MORE DO YOU WANT FROM ME?!?!
+      tlb_entries = (unsigned int) strtoul(argv[++i], &name, 10);
+      tlb_ways = min(tlb_entries, (unsigned int) MSIM_TLB_WAYS);
+      if (*name == ':')
+        tlb_ways = (unsigned int) strtoul(name + 1, &name, 10);
+      
+      // Sets are picked by the low bits of the page, so come in powers of two
+      if (*name != '\0' || tlb_ways < 1 || tlb_entries % tlb_ways != 0
+          || tlb_entries == 0
+          || ((tlb_entries / tlb_ways) & (tlb_entries / tlb_ways - 1)) != 0)
+      {
+        cout << "Invalid TLB " << argv[i];
+        cout << ": expected <entries>[:<ways>] with a power of two sets"
+             << endl;
+        return 1;
+      }
     }
-    
-    
-    
-    // Output frame state
-    cout << setw(padding) << ref_string[i] << " -> ";
-    for (j = 0; j < num_frames; j++)
+    else if (strcmp(argv[i], "--times") == 0 && i + 1 < argc)
     {
-      cout << "| ";
-      if (j < frames.size())
+      name = argv[++i];
+      for (fields = 0; fields < 3; fields++)
       {
-        cout << setw(padding) << frames[j] << " ";
+        times[fields] = strtod(name + (fields > 0), &name);
+        if (times[fields] < 0.0 || *name != (fields < 2 ? ':' : '\0'))
+          break;
       }
-      else
+      if (fields < 3)
       {
-        cout << setw(padding) << " " << " ";
+        cout << "Invalid access times " << argv[i];
+        cout << ": expected <tlb>:<memory>:<swap>" << endl;
+        return 1;
       }
     }
-    cout << "|";
-    if (fault)
+    else
     {
-      cout << " FAULT";
+      cout << "Unknown option " << argv[i] << endl;
+      return 1;
     }
-    cout << endl;
   }
   
-  // Final output
-  cout << "\n";
-  cout << "page faults: " << faults << endl;
-}
-
-/***************************************************************************//**
- * msim_lru
- *
- * Author:
- * Daniel Andrus
- * 
- * Description:
- * Function to simulate a "least recently used" page management algorithm. Using
- * a supplied reference string in the form of an integer vector and a maximum
- * number of frames available to the system, this function displays the state of
- * the memory frames at each stage of the simulation, highlighting where page
- * faults occur and keeping a running total of the number of page faults that
- * occur.
- *
- * Parameters:
- * ref_string - vector of integers supplied in the order in which the pages are
- * accessed by the system.
- * num_frames - Maximum number of frames available to the simulation.
- ******************************************************************************/
-void msim_lru(vector<int>& ref_string, unsigned int num_frames)
-{
-  vector<int> frames;
-  auto frame = frames.end();
-  bool fault;
-  int faults = 0;
-  int padding = 0;
-  int temp;
-  unsigned int i;
-  unsigned int j;
+  // Parse memory sizes, either one count or a range of them
+  range = (strchr(argv[2], ':') != NULL);
+  frames[0] = (unsigned int) strtoul(argv[2], &name, 10);
+  frames[1] = frames[0];
+  if (*name == ':')
+    frames[1] = (unsigned int) strtoul(name + 1, &name, 10);
+  if (*name == ':')
+    frames[2] = (unsigned int) strtoul(name + 1, &name, 10);
   
-  vector<int> queue;          // LRU vector that drives the algorithm
+  // Make sure frame counts are positive integers
+  if (*name != '\0' || frames[0] < 1 || frames[1] < frames[0]
+      || frames[2] < 1)
+  {
+    cout << "Invalid number of frames " << argv[2];
+    cout << ": expected positive integer or <first>:<last>[:<step>]" << endl;
+    return 1;
+  }
   
-  // For formatting reasons, find 'widest' number
-  for (i = 0; i < ref_string.size(); i++)
+  // Parse algorithm argument, a comma separated list for sweeps
+  for (name = strtok(argv[3], ","); name != NULL; name = strtok(NULL, ","))
   {
-    // Handle positive and negative numbers differently
-    if (ref_string[i] < 0)
+    alg = msim_parse_alg(name);
+    if (alg < 0 || (range && alg == MSIM_MRC))
     {
-      temp = (int) (ceil(log10(-ref_string[i] + 1))) + 1;
+      cout << "Unknown page replacement algorithm " << name << endl;
+      return 1;
     }
-    else
+    
+    // Each policy is run once, in the order it was first named
+    if (range && alg == MSIM_ALL)
     {
-      temp = (int) (ceil(log10(ref_string[i] + 1)));
+      for (i = 0; i < (int) MSIM_NUM_POLICIES; i++)
+      {
+        if (find(algs.begin(), algs.end(), MSIM_POLICIES[i]) == algs.end())
+          algs.push_back(MSIM_POLICIES[i]);
+      }
     }
-    
-    if (temp > padding) padding = temp;
+    else if (find(algs.begin(), algs.end(), alg) == algs.end())
+      algs.push_back(alg);
+  }
+
+  // A list of nothing but commas names no algorithm at all
+  if (algs.empty())
+  {
+    cout << "Unknown page replacement algorithm " << argv[3] << endl;
+    return 1;
+  }
+
+  // Plain runs, anomaly searches and variable allocation take one algorithm
+  if ((!range || find(algs.begin(), algs.end(), MSIM_BELADY) != algs.end()
+       || find(algs.begin(), algs.end(), MSIM_WS) != algs.end()
+       || find(algs.begin(), algs.end(), MSIM_PFF) != algs.end()
+       || find(algs.begin(), algs.end(), MSIM_SHARDS) != algs.end())
+      && algs.size() != 1)
+  {
+    cout << "Expected one page replacement algorithm" << endl;
+    return 1;
   }
   
-  cout << right;
+  // The hierarchy follows a single run of a policy through memory
+  if (tlb_entries != 0
+      && (range || processes || stream || trace_is_stream(argv[1])
+          || find(MSIM_POLICIES, MSIM_POLICIES + MSIM_NUM_POLICIES, algs[0])
+             == MSIM_POLICIES + MSIM_NUM_POLICIES))
+  {
+    cout << "The TLB is simulated for one frame count and one page"
+         << " replacement policy" << endl;
+    return 1;
+  }
   
-  // Work through reference string
-  for (i = 0; i < ref_string.size(); i++)
+  // Processes compete for the frames under one policy at a time
+  if (processes)
   {
-    frame = find(queue.begin(), queue.end(), ref_string[i]);
-    fault = (frame == queue.end());
-    
-    // Check for page faults
-    if (fault)
+    if (range || find(MSIM_POLICIES, MSIM_POLICIES + MSIM_NUM_POLICIES,
+                      algs[0]) == MSIM_POLICIES + MSIM_NUM_POLICIES)
     {
-      // Handle page faults
-      faults++;
-        
-      // Check if we have spare space
-      if (frames.size() < num_frames)
-      {
-        // We have plenty of space, just stick it in there (lennyface.jpg)
-        frames.push_back(ref_string[i]);
-      }
-      else
-      {
-        // Out of space, pop first item off queue and replace that frame
-        frame = find(frames.begin(), frames.end(), queue[0]);
-        *frame = ref_string[i];
-        queue.erase(queue.begin());
-      }
+      cout << "Multi-process traces take one frame count and one page"
+           << " replacement policy" << endl;
+      return 1;
     }
-    else
+    if (page_size != 0 || trace_is_binary(argv[1]) || trace_is_stream(argv[1]))
     {
-      // Remove item from queue so we can insert it at beginning again
-      queue.erase(frame);
+      cout << "Multi-process traces are read from text files of pid:page"
+           << " entries" << endl;
+      return 1;
+    }
+    if (!trace_open_processes(argv[1], ref_string))
+    {
+      cout << "Failed to open " << argv[1] << " for input" << endl;
+      return 1;
+    }
+    msim_processes(algs[0], ref_string, frames[0], sharing, config);
+    return 0;
+  }
+  
+  // Online policies can follow a pipe or standard input as it is written, and
+  // sampling reads every trace that way so that none is held in memory
+  if (stream || trace_is_stream(argv[1]) || algs[0] == MSIM_SHARDS)
+  {
+    if ((range && algs[0] != MSIM_SHARDS) || !msim_streamable(algs[0]))
+    {
+      cout << "Streamed traces take shards, or one frame count and one of"
+           << " fifo, lru, lfu, mfu, sc, c or esc" << endl;
+      return 1;
+    }
+    if (page_size != 0 && trace_is_binary(argv[1]))
+    {
+      cout << "Binary traces hold page numbers, not addresses" << endl;
+      return 1;
+    }
+    if (!trace_stream_open(argv[1], input, page_size))
+    {
+      cout << "Failed to open " << argv[1] << " for input" << endl;
+      return 1;
     }
     
-    // Add item to back of queue no matter what case
-    queue.push_back(ref_string[i]);
-    
-    // Output frame state
-    cout << setw(padding) << ref_string[i] << " -> ";
-    for (j = 0; j < num_frames; j++)
+    if (algs[0] == MSIM_SHARDS)
     {
-      cout << "| ";
-      if (j < frames.size())
-      {
-        cout << setw(padding) << frames[j] << " ";
-      }
-      else
-      {
-        cout << setw(padding) << " " << " ";
-      }
+      // A single count n reports 1 through n
+      if (!range)
+        frames[0] = 1;
+      msim_shards(input, frames[0], frames[1], frames[2], rate, sample_pages);
     }
-    cout << "|";
-    if (fault)
+    else
     {
-      cout << " FAULT";
+      msim_tally tally(interval);
+      msim_stream(algs[0], input, frames[0], tally, config);
     }
-    cout << endl;
+    if (!input.ok)
+      cout << "Stopped at a malformed entry or read error" << endl;
+    return 0;
   }
   
-  // Final output
-  cout << "\n";
-  cout << "page faults: " << faults << endl;
+  // Read in values from file, turning addresses into pages if asked to
+  if (page_size != 0 && trace_is_binary(argv[1]))
+  {
+    cout << "Binary traces hold page numbers, not addresses" << endl;
+    return 1;
+  }
+  // A text trace would be held whole in memory, defeating the window
+  if (config.window != 0 && !trace_is_binary(argv[1]))
+  {
+    cout << "--window takes a binary trace; make one with msim convert"
+         << endl;
+    return 1;
+  }
+  if (page_size != 0 ? !trace_open_addresses(argv[1], ref_string, page_size)
+                     : !trace_open(argv[1], ref_string, TRACE_PAGES))
+  {
+    cout << "Failed to open " << argv[1] << " for input" << endl;
+    return 1;
+  }
+  
+  // A lone windowed opt run keeps a binary trace mapped, so it needs no page
+  // table
+  if (page_size == 0 && (algs[0] != MSIM_OPT || range || config.window == 0))
+    trace_remap(ref_string);
+
+  // Call appropriate algorithm function
+  if (algs[0] == MSIM_BELADY)
+  {
+    // A single count n searches 1 through n
+    if (!range)
+      frames[0] = 1;
+    msim_belady(ref_string, frames[0], frames[1], frames[2]);
+  }
+  else if (algs[0] == MSIM_WS || algs[0] == MSIM_PFF)
+    msim_variable(algs[0], ref_string, frames[0], frames[1], frames[2]);
+  else if (range)
+    msim_sweep(ref_string, algs, frames[0], frames[1], frames[2], config,
+               fout.is_open() ? (ostream&) fout : cout);
+  else if (algs[0] == MSIM_MRC)
+    msim_mrc(ref_string, frames[0]);
+  else if (algs[0] == MSIM_ALL)
+    msim_all(ref_string, frames[0], config);
+  else if (tlb_entries != 0)
+    msim_hierarchy(algs[0], ref_string, frames[0], tlb_entries, tlb_ways,
+                   times, out, config);
+  else
+    msim_simulate(algs[0], ref_string, frames[0], out, config);
+
+  return 0;
 }
 
 /***************************************************************************//**
- * msim_lfu
+ * msim_parse_alg
  *
  * Author:
  * Daniel Andrus
  * 
  * Description:
- * Function to simulate a "least frequently used" page management algorithm.
- * Using a supplied reference string in the form of an integer vector and a
- * maximum number of frames available to the system, this function displays the
- * state of the memory frames at each stage of the simulation, highlighting
- * where page faults occur and keeping a running total of the number of page
- * faults that occur.
+ * Translates the name of an algorithm given on the command line.
  *
  * Parameters:
- * ref_string - vector of integers supplied in the order in which the pages are
- * accessed by the system.
- * num_frames - Maximum number of frames available to the simulation.
+ * name - Name of the algorithm.
+ *
+ * Returns:
+ * The matching msim_alg value, or -1 if the name is not recognized.
  ******************************************************************************/
-void msim_lfu(vector<int>& ref_string, unsigned int num_frames)
+int msim_parse_alg(const char* name)
 {
-  vector<int> frames;
-  auto frame = frames.end();
-  bool fault;
-  int faults = 0;
-  int padding = 0;
-  int temp;
-  unsigned int i;
-  unsigned int j;
-  
-  vector<int> counts;
+  int alg;
   
-  // For formatting reasons, find 'widest' number
-  for (i = 0; i < ref_string.size(); i++)
+  for (alg = MSIM_FIFO; alg <= MSIM_BELADY; alg++)
   {
-    // Handle positive and negative numbers differently
-    if (ref_string[i] < 0)
-    {
-      temp = (int) (ceil(log10(-ref_string[i] + 1))) + 1;
-    }
-    else
-    {
-      temp = (int) (ceil(log10(ref_string[i] + 1)));
-    }
-    
-    if (temp > padding) padding = temp;
+    if (strcmp(name, msim_alg_name(alg)) == 0)
+      return alg;
   }
   
-  cout << right;
-  
-  // Work through reference string
-  for (i = 0; i < ref_string.size(); i++)
-  {
-    frame = find(frames.begin(), frames.end(), ref_string[i]);
-    fault = (frame == frames.end());
-    
-    // Check for page faults
-    if (fault)
-    {
-      // Handle page faults
-      faults++;
-        
-      // Check if we have spare space
-      if (frames.size() < num_frames)
-      {
-        // We have plenty of space, just stick it in there (lennyface.jpg)
-        frames.push_back(ref_string[i]);
-        counts.push_back(1);
-      }
-      else
+  return -1;
+}
+
+/***************************************************************************//**
+ * msim_alg_name
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Gives the command line name of an algorithm.
+ *
+ * Parameters:
+ * alg - An msim_alg value.
+ *
+ * Returns:
+ * Name of the algorithm.
+ ******************************************************************************/
+const char* msim_alg_name(int alg)
+{
+  static const char* names[] =
+    { "fifo", "opt", "lru", "lfu", "sc", "c", "mfu", "esc", "arc", "car",
+      "lirs", "cpro", "tinylfu", "ws", "pff", "shards",
+      "mrc", "all", "belady" };
+  
+  return names[alg];
+}
+
+/***************************************************************************//**
+ * msim_scan_pays
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Decides whether a simulation should find resident pages by scanning the
+ * frames rather than through the page table. Only traces with enough distinct
+ * pages that the table falls out of cache are scanned; small traces keep the
+ * table however few frames they are run with.
+ *
+ * Parameters:
+ * ref_string - The remapped reference string to be simulated.
+ * num_frames - Number of frames in the simulation.
+ *
+ * Returns:
+ * True if scan_index should be used.
+ ******************************************************************************/
+static bool msim_scan_pays(trace& ref_string, unsigned int num_frames)
+{
+  return num_frames <= MSIM_SCAN_FRAMES
+         && ref_string.distinct() >= MSIM_SCAN_PAGES;
+}
+
+/***************************************************************************//**
+ * msim_simulate
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Runs the simulation driver with the page replacement policy selected by
+ * alg, displaying the state of the memory frames at each stage of the
+ * simulation, highlighting where page faults occur and keeping a running total
+ * of the number of page faults that occur. Adaptive policies follow their
+ * summary with how their target moved during the run.
+ *
+ * Parameters:
+ * alg - The msim_alg value of the policy to simulate.
+ * ref_string - trace of page numbers supplied in the order in which the pages
+ * are accessed by the system.
+ * num_frames - Maximum number of frames available to the simulation.
+ * out - Output settings controlling how much of each step is displayed.
+ * config - Tuning knobs for the policies.
+ *
+ * Returns:
+ * Number of page faults that occurred.
+ ******************************************************************************/
+unsigned int msim_simulate(int alg, trace& ref_string, unsigned int num_frames,
+  msim_output& out, const policy_config& config)
+{
+  unsigned int faults;
+  
+  switch (alg)
+  {
+  case MSIM_FIFO:
+  {
+    fifo_policy policy(ref_string, num_frames, config);
+    if (msim_scan_pays(ref_string, num_frames))
+      return msim_run<scan_index>(ref_string, num_frames, policy, out);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_OPT:
+  {
+    opt_policy policy(ref_string, num_frames, config);
+    if (ref_string.distinct() == 0)
+      return msim_run<hash_index>(ref_string, num_frames, policy, out);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_LRU:
+  {
+    lru_policy policy(ref_string, num_frames, config);
+    if (msim_scan_pays(ref_string, num_frames))
+      return msim_run<scan_index>(ref_string, num_frames, policy, out);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_LFU:
+  {
+    lfu_policy policy(ref_string, num_frames, config);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_SC:
+  {
+    sc_policy policy(ref_string, num_frames, config);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_C:
+  {
+    clock_policy policy(ref_string, num_frames, config);
+    if (msim_scan_pays(ref_string, num_frames))
+      return msim_run<scan_index>(ref_string, num_frames, policy, out);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_MFU:
+  {
+    mfu_policy policy(ref_string, num_frames, config);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_ESC:
+  {
+    esc_policy policy(ref_string, num_frames, config);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_ARC:
+  {
+    arc_policy policy(ref_string, num_frames, config);
+    faults = msim_run<table_index>(ref_string, num_frames, policy, out);
+    if (out.summary)
+      policy.history.report("p", num_frames);
+    return faults;
+  }
+    
+  case MSIM_CAR:
+  {
+    car_policy policy(ref_string, num_frames, config);
+    faults = msim_run<table_index>(ref_string, num_frames, policy, out);
+    if (out.summary)
+      policy.history.report("p", num_frames);
+    return faults;
+  }
+    
+  case MSIM_LIRS:
+  {
+    lirs_policy policy(ref_string, num_frames, config);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+    
+  case MSIM_CLOCKPRO:
+  {
+    clockpro_policy policy(ref_string, num_frames, config);
+    faults = msim_run<table_index>(ref_string, num_frames, policy, out);
+    if (out.summary)
+      policy.history.report("mc", num_frames);
+    return faults;
+  }
+    
+  case MSIM_TINYLFU:
+  {
+    tinylfu_policy policy(ref_string, num_frames, config);
+    return msim_run<table_index>(ref_string, num_frames, policy, out);
+  }
+  }
+  
+  return 0;
+}
+
+/***************************************************************************//**
+ * msim_mrc
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Computes the LRU miss curve for every frame count from 1 to num_frames in a
+ * single pass over the reference string. LRU has the stack property, so a
+ * reference hits with f frames exactly when its stack distance (the number of
+ * distinct pages touched since the previous reference to the same page,
+ * itself included) is at most f.
+ *
+ * Stack distances are counted with a Fenwick tree over reference positions in
+ * which only the latest reference to each page is marked, making the whole
+ * pass O(n log n). The resulting table lists the number of page faults LRU
+ * would incur for each frame count.
+ *
+ * Parameters:
+ * ref_string - trace of page numbers supplied in the order in which the pages
+ * are accessed by the system.
+ * num_frames - Largest number of frames to report.
+ ******************************************************************************/
+void msim_mrc(trace& ref_string, unsigned int num_frames)
+{
+  vector<int> tree;                     // marks latest reference of each page
+  vector<unsigned int> distances;       // histogram of stack distances
+  vector<unsigned int> curve;           // page faults for each frame count
+  vector<unsigned int> last;            // page -> position of last reference
+  unsigned int cold = 0;                // first references, miss at any size
+  unsigned int previous;
+  unsigned int distance;
+  unsigned int faults;
+  unsigned int i;
+  unsigned int f;
+  
+  tree.resize(ref_string.size() + 1, 0);
+  last.resize(ref_string.distinct(), MSIM_NO_FRAME);
+  
+  // Bucket num_frames + 1 collects every distance too large to be reported
+  distances.resize(num_frames + 2, 0);
+  
+  for (i = 0; i < ref_string.size(); i++)
+  {
+    previous = last[ref_string[i]];
+    if (previous == MSIM_NO_FRAME)
+    {
+      cold++;
+    }
+    else
+    {
+      // Distinct pages referenced strictly between the two references, plus
+      // the page itself
+      distance = fenwick_sum(tree, i) - fenwick_sum(tree, previous + 1) + 1;
+      distances[min(distance, num_frames + 1)]++;
+      
+      fenwick_add(tree, previous + 1, -1);
+    }
+    last[ref_string[i]] = i;
+    fenwick_add(tree, i + 1, 1);
+  }
+  
+  // Faults for f frames are cold misses plus every distance greater than f
+  curve.resize(num_frames + 1);
+  faults = cold + distances[num_frames + 1];
+  for (f = num_frames; f >= 1; f--)
+  {
+    curve[f] = faults;
+    faults += distances[f];
+  }
+  
+  // Output curve
+  cout << right;
+  cout << setw(10) << "frames" << setw(14) << "page faults" << endl;
+  for (f = 1; f <= num_frames; f++)
+  {
+    cout << setw(10) << f << setw(14) << curve[f] << "\n";
+  }
+  cout << flush;
+}
+
+/***************************************************************************//**
+ * msim_all
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates every page replacement policy on the same reference string at
+ * once, each on its own thread, and prints a side by side comparison of their
+ * page faults, hit ratios and running times. The reference string is only
+ * read, so all threads share the single loaded copy.
+ *
+ * Parameters:
+ * ref_string - trace of page numbers supplied in the order in which the pages
+ * are accessed by the system.
+ * num_frames - Maximum number of frames available to the simulation.
+ * config - Tuning knobs for the policies.
+ ******************************************************************************/
+void msim_all(trace& ref_string, unsigned int num_frames,
+  const policy_config& config)
+{
+  const int* algs = MSIM_POLICIES;
+  const unsigned int num_algs = MSIM_NUM_POLICIES;
+  vector<thread> workers;
+  vector<msim_output> outs(num_algs);
+  vector<unsigned int> faults(num_algs);
+  unsigned int i;
+  
+  // Run each policy quietly on its own thread
+  for (i = 0; i < num_algs; i++)
+  {
+    outs[i].sample = 0;
+    outs[i].summary = false;
+    workers.push_back(thread([&, i]()
+    {
+      faults[i] = msim_simulate(algs[i], ref_string, num_frames, outs[i],
+                                config);
+    }));
+  }
+  for (i = 0; i < num_algs; i++)
+    workers[i].join();
+  
+  // Output comparison
+  cout << right;
+  cout << setw(10) << "algorithm" << setw(14) << "page faults";
+  if (ref_string.has_writes())
+    cout << setw(14) << "write-backs";
+  cout << setw(12) << "hit ratio" << setw(12) << "time (s)" << "\n";
+  for (i = 0; i < num_algs; i++)
+  {
+    cout << setw(10) << msim_alg_name(algs[i]) << setw(14) << faults[i];
+    if (ref_string.has_writes())
+      cout << setw(14) << outs[i].writebacks;
+    cout << fixed << setprecision(4) << setw(12)
+         << (ref_string.size() ? (double) (ref_string.size() - faults[i])
+                                 / ref_string.size() : 0.0)
+         << setprecision(6) << setw(12) << outs[i].elapsed << "\n";
+  }
+  cout.unsetf(ios::floatfield);
+  cout << flush;
+}
+
+/***************************************************************************//**
+ * msim_sweep
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates a set of page replacement policies at every frame count of a
+ * range and writes the results as CSV. Every (policy, frame count) pair is an
+ * independent task on a work-stealing thread pool, and all tasks share the one
+ * loaded copy of the reference string. Results are written in grid order once
+ * every task has finished.
+ *
+ * Parameters:
+ * ref_string - trace of page numbers supplied in the order in which the pages
+ * are accessed by the system.
+ * algs - msim_alg values of the policies to simulate.
+ * first - Smallest number of frames.
+ * last - Largest number of frames.
+ * step - Distance between successive frame counts.
+ * config - Tuning knobs for the policies.
+ * fout - Stream receiving the CSV.
+ ******************************************************************************/
+void msim_sweep(trace& ref_string, vector<int>& algs, unsigned int first,
+  unsigned int last, unsigned int step, const policy_config& config,
+  ostream& fout)
+{
+  work_pool pool;
+  unsigned int num_sizes = (last - first) / step + 1;
+  vector<unsigned int> faults(algs.size() * num_sizes);
+  vector<double> elapsed(algs.size() * num_sizes);
+  vector<unsigned int> writebacks(algs.size() * num_sizes);
+  unsigned int i;
+  unsigned int j;
+  
+  // One task per grid point
+  for (i = 0; i < algs.size(); i++)
+  {
+    for (j = 0; j < num_sizes; j++)
+    {
+      pool.submit([&, i, j]()
       {
-        // Out of space, choose item to replace
-        frame = counts.begin();
-        
-        // Choose item with lowest count to replace
-        for (j = 0; j < counts.size(); j++)
-        {
-          if (counts[j] < *frame)
-          {
-            frame = counts.begin() + j;
-          }
-        }
+        msim_output out;
         
-        // Replace element at position frame
-        counts[frame - counts.begin()] = 1;
-        frames[frame - counts.begin()] = ref_string[i];
-      }
+        out.sample = 0;
+        out.summary = false;
+        faults[i * num_sizes + j] = msim_simulate(algs[i], ref_string,
+                                                  first + j * step, out,
+                                                  config);
+        elapsed[i * num_sizes + j] = out.elapsed;
+        writebacks[i * num_sizes + j] = out.writebacks;
+      });
     }
-    else
+  }
+  pool.run();
+  
+  // Output results
+  fout << "algorithm,frames,page faults,"
+       << (ref_string.has_writes() ? "write-backs," : "")
+       << "hit ratio,time (s)\n";
+  fout << fixed;
+  for (i = 0; i < algs.size(); i++)
+  {
+    for (j = 0; j < num_sizes; j++)
+    {
+      fout << msim_alg_name(algs[i]) << ',' << first + j * step << ','
+           << faults[i * num_sizes + j] << ',';
+      if (ref_string.has_writes())
+        fout << writebacks[i * num_sizes + j] << ',';
+      fout << setprecision(6)
+           << (ref_string.size() ? (double) (ref_string.size()
+               - faults[i * num_sizes + j]) / ref_string.size() : 0.0)
+           << ',' << elapsed[i * num_sizes + j] << '\n';
+    }
+  }
+  fout.unsetf(ios::floatfield);
+  fout << flush;
+}
+
+/***************************************************************************//**
+ * msim_belady
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Searches for Belady's anomaly: frame counts at which FIFO incurs more page
+ * faults than it does with fewer frames. FIFO is simulated at every frame
+ * count of the range in parallel on a work-stealing thread pool, and for each
+ * adjacent pair where the fault count goes up, the two runs are replayed side
+ * by side to list the offsets in the trace where one faults and the other
+ * does not.
+ *
+ * Work is shared between frame counts: with f frames nothing is replaced
+ * before the (f + 1)th distinct page is first referenced, so every run starts
+ * there with its frames holding the first f distinct pages, found in one pass
+ * shared by every run.
+ *
+ * Parameters:
+ * ref_string - trace of page numbers supplied in the order in which the pages
+ * are accessed by the system.
+ * first - Smallest number of frames.
+ * last - Largest number of frames.
+ * step - Distance between successive frame counts.
+ ******************************************************************************/
+void msim_belady(trace& ref_string, unsigned int first, unsigned int last,
+  unsigned int step)
+{
+  const unsigned int max_offsets = 20;  // offsets listed per anomaly
+  work_pool pool;
+  unsigned int num_sizes = (last - first) / step + 1;
+  vector<unsigned int> faults(num_sizes);
+  vector<unsigned int> first_seen;      // position of each new page
+  vector<char> seen(ref_string.distinct(), 0);
+  vector<size_t> offsets;
+  unsigned int anomalies = 0;
+  size_t i;
+  unsigned int j;
+  
+  // Find where every distinct page is first referenced
+  for (i = 0; i < ref_string.size(); i++)
+  {
+    if (!seen[ref_string[i]])
+    {
+      seen[ref_string[i]] = 1;
+      first_seen.push_back(i);
+    }
+  }
+  
+  // Count faults at each frame count in parallel
+  for (j = 0; j < num_sizes; j++)
+  {
+    pool.submit([&, j]()
+    {
+      fifo_sim sim(first + j * step, ref_string.distinct());
+      size_t k;
+      
+      sim.preload(ref_string, first_seen);
+      k = sim.num_frames < first_seen.size() ? first_seen[sim.num_frames]
+                                             : ref_string.size();
+      for ( ; k < ref_string.size(); k++)
+        sim.step(ref_string[k]);
+      faults[j] = sim.faults;
+    });
+  }
+  pool.run();
+  
+  // Output curve
+  cout << right;
+  cout << setw(10) << "frames" << setw(14) << "page faults" << "\n";
+  for (j = 0; j < num_sizes; j++)
+    cout << setw(10) << first + j * step << setw(14) << faults[j] << "\n";
+  cout << "\n";
+  
+  // Replay every anomaly to find where the runs part ways
+  for (j = 1; j < num_sizes; j++)
+  {
+    if (faults[j] <= faults[j - 1])
+      continue;
+    
+    fifo_sim fewer(first + (j - 1) * step, ref_string.distinct());
+    fifo_sim more(first + j * step, ref_string.distinct());
+    
+    offsets.clear();
+    for (i = 0; i < ref_string.size(); i++)
+    {
+      if (fewer.step(ref_string[i]) != more.step(ref_string[i]))
+        offsets.push_back(i);
+    }
+    
+    anomalies++;
+    cout << "anomaly: " << fewer.num_frames << " -> " << more.num_frames
+         << " frames, " << faults[j - 1] << " -> " << faults[j]
+         << " page faults\n";
+    cout << "  runs diverge at " << offsets.size() << " offsets:";
+    for (i = 0; i < offsets.size() && i < max_offsets; i++)
+      cout << " " << offsets[i];
+    if (offsets.size() > max_offsets)
+      cout << " ...";
+    cout << "\n";
+  }
+  
+  cout << "anomalies found: " << anomalies << endl;
+}
+
+/***************************************************************************//**
+ * msim_bench
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Times the two ways the driver can find the frame holding a page: scanning
+ * the frames with each lookup kernel, and the flat page table. For frame
+ * counts from 4 up to 256, frames are filled with pages spread across the
+ * page ids and searched for a fixed random mix of resident and other pages,
+ * half of each. The table shows the average time of one lookup, so the frame
+ * count at which scanning stops beating the page table can be read off it.
+ * Kernels this processor cannot run are left blank, and any kernel that finds
+ * a different number of resident pages than the table is reported as wrong.
+ *
+ * Parameters:
+ * num_pages - Number of distinct page ids, which sets the size of the table.
+ * lookups - Number of lookups timed for each entry.
+ ******************************************************************************/
+void msim_bench(unsigned int num_pages, unsigned int lookups)
+{
+  const lookup_kernel kernels[] = { lookup_scalar, lookup_sse41, lookup_avx2 };
+  const char* names[] = { "scalar", "sse4.1", "avx2" };
+  const unsigned int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+  vector<int> queries(lookups);
+  vector<int> keys;
+  chrono::steady_clock::time_point start;
+  double elapsed;
+  double table_time;
+  unsigned int hits;                    // resident pages found by the table
+  unsigned int sum;
+  unsigned int f;
+  unsigned int k;
+  unsigned int q;
+  uint32_t seed = 2463534242u;
+  
+  cout << right << fixed << setprecision(2);
+  cout << setw(10) << "frames";
+  for (k = 0; k < num_kernels; k++)
+    cout << setw(10) << names[k];
+  cout << setw(10) << "table" << "   (ns per lookup)\n";
+  
+  for (f = 4; f <= 256 && f <= num_pages; f *= 2)
+  {
+    table_index index(num_pages, f);
+    
+    // Spread resident pages across the ids
+    keys.assign((f + LOOKUP_BLOCK - 1) / LOOKUP_BLOCK * LOOKUP_BLOCK, -1);
+    for (k = 0; k < f; k++)
     {
-      counts[frame - frames.begin()]++;
+      keys[k] = (int) ((uint64_t) k * num_pages / f);
+      index.insert(keys[k], k);
     }
     
-    // Output frame state
-    cout << setw(padding) << ref_string[i] << " -> ";
-    for (j = 0; j < num_frames; j++)
+    // Half the lookups are for resident pages
+    for (q = 0; q < lookups; q++)
     {
-      cout << "| ";
-      if (j < frames.size())
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      queries[q] = (seed & 1) ? keys[(seed >> 1) % f]
+                              : (int) ((seed >> 1) % num_pages);
+    }
+    
+    // Time the page table first, as the reference for the kernels
+    hits = 0;
+    start = chrono::steady_clock::now();
+    for (q = 0; q < lookups; q++)
+    {
+      if (index.find(queries[q]) != MSIM_NO_FRAME)
+        hits++;
+    }
+    table_time = chrono::duration<double>(chrono::steady_clock::now() - start)
+                   .count();
+    
+    cout << setw(10) << f;
+    for (k = 0; k < num_kernels; k++)
+    {
+      if (!lookup_supported(kernels[k]))
+      {
+        cout << setw(10) << "-";
+        continue;
+      }
+      
+      sum = 0;
+      start = chrono::steady_clock::now();
+      for (q = 0; q < lookups; q++)
       {
-        cout << setw(padding) << frames[j] << " ";
+        if (kernels[k](keys.data(), keys.size(), queries[q]) < f)
+          sum++;
       }
+      elapsed = chrono::duration<double>(chrono::steady_clock::now() - start)
+                  .count();
+      if (sum != hits)
+        cout << setw(10) << "wrong";
       else
+        cout << setw(10) << elapsed * 1e9 / lookups;
+    }
+    cout << setw(10) << table_time * 1e9 / lookups << "\n";
+  }
+  
+  for (k = 0; k < num_kernels && kernels[k] != lookup_select(); k++)
+    ;
+  cout << "kernel in use: " << names[k] << ", scanning up to "
+       << MSIM_SCAN_FRAMES << " frames of traces with at least "
+       << MSIM_SCAN_PAGES << " pages" << endl;
+  cout.unsetf(ios::floatfield);
+}
+
+/***************************************************************************//**
+ * fifo_sim::fifo_sim
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Creates an empty FIFO simulation.
+ *
+ * Parameters:
+ * num_frames - Number of frames available to the simulation.
+ * num_pages - Number of distinct page ids in the trace to be simulated.
+ ******************************************************************************/
+fifo_sim::fifo_sim(unsigned int num_frames, size_t num_pages)
+  : slot_of(num_pages, MSIM_NO_FRAME), num_frames(num_frames), hand(0),
+    faults(0)
+{
+}
+
+/***************************************************************************//**
+ * fifo_sim::preload
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Puts the simulation in the state it would reach just before the first
+ * replacement, or at the end of the trace if no replacement ever happens.
+ *
+ * Parameters:
+ * ref_string - The trace being simulated.
+ * first_seen - Position of the first reference to each distinct page, in
+ * order.
+ ******************************************************************************/
+void fifo_sim::preload(trace& ref_string, vector<unsigned int>& first_seen)
+{
+  unsigned int j;
+  
+  for (j = 0; j < num_frames && j < first_seen.size(); j++)
+  {
+    slot_of[ref_string[first_seen[j]]] = j;
+    frames.push_back(ref_string[first_seen[j]]);
+  }
+  faults = frames.size();
+}
+
+/***************************************************************************//**
+ * fifo_sim::step
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates one reference.
+ *
+ * Parameters:
+ * page - The id of the page referenced.
+ *
+ * Returns:
+ * True if the reference caused a page fault.
+ ******************************************************************************/
+bool fifo_sim::step(int page)
+{
+  if (slot_of[page] != MSIM_NO_FRAME)
+    return false;
+  
+  faults++;
+  if (frames.size() < num_frames)
+  {
+    slot_of[page] = frames.size();
+    frames.push_back(page);
+  }
+  else
+  {
+    slot_of[frames[hand]] = MSIM_NO_FRAME;
+    slot_of[page] = hand;
+    frames[hand] = page;
+    hand = (hand + 1) % num_frames;
+  }
+  return true;
+}
+
+/***************************************************************************//**
+ * fenwick_add
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Adds a value to one position of a Fenwick (binary indexed) tree.
+ *
+ * Parameters:
+ * tree - The tree, indexed from 1.
+ * pos - Position to update, from 1 to tree.size() - 1.
+ * value - Amount to add.
+ ******************************************************************************/
+void fenwick_add(vector<int>& tree, unsigned int pos, int value)
+{
+  for ( ; pos < tree.size(); pos += pos & (~pos + 1))
+  {
+    tree[pos] += value;
+  }
+}
+
+/***************************************************************************//**
+ * fenwick_sum
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Sums the first pos positions of a Fenwick (binary indexed) tree.
+ *
+ * Parameters:
+ * tree - The tree, indexed from 1.
+ * pos - Number of leading positions to sum, 0 yielding an empty sum.
+ *
+ * Returns:
+ * Sum of positions 1 through pos.
+ ******************************************************************************/
+int fenwick_sum(vector<int>& tree, unsigned int pos)
+{
+  int sum = 0;
+  
+  for ( ; pos > 0; pos -= pos & (~pos + 1))
+  {
+    sum += tree[pos];
+  }
+  
+  return sum;
+}
+
+/***************************************************************************//**
+ * msim_output::begin
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Prepares the output for a new simulation. Finds the width of the widest
+ * page number so the frame table lines up and starts the simulation timer.
+ *
+ * Parameters:
+ * ref_string - The remapped reference string about to be simulated.
+ * num_frames - Number of frames shown in each row of the table.
+ ******************************************************************************/
+void msim_output::begin(trace& ref_string, unsigned int num_frames)
+{
+  size_t count;
+  size_t i;
+  long long value;
+  int temp;
+  
+  this->num_frames = num_frames;
+  source = &ref_string;
+  padding = 0;
+  buffer.clear();
+  
+  // For formatting reasons, find 'widest' number, among the references
+  // themselves if the trace holds page numbers rather than ids
+  count = ref_string.distinct() != 0 ? ref_string.distinct()
+                                     : ref_string.size();
+  for (i = 0; i < count && sample != 0; i++)
+  {
+    value = ref_string.distinct() != 0 ? ref_string.pages[i] : ref_string[i];
+    
+    // Handle positive and negative numbers differently
+    if (value < 0)
+    {
+      temp = (int) (ceil(log10(-value + 1))) + 1;
+    }
+    else
+    {
+      temp = (int) (ceil(log10(value + 1)));
+    }
+    
+    if (temp > padding) padding = temp;
+  }
+  
+  start = chrono::steady_clock::now();
+}
+
+/***************************************************************************//**
+ * msim_output::step
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Records the state of the frames after one reference, if that reference is
+ * selected by the sampling interval. Sampled rows are prefixed with the
+ * position of the reference so gaps in the table are apparent.
+ *
+ * Parameters:
+ * i - Position of the reference within the reference string.
+ * reference - The id of the page that was referenced.
+ * frames - Ids of the pages currently held by each frame.
+ * fault - Whether the reference caused a page fault.
+ * writeback - Whether the fault evicted a dirty page.
+ ******************************************************************************/
+void msim_output::step(unsigned int i, int reference, vector<int>& frames,
+  bool fault, bool writeback)
+{
+  unsigned int j;
+  
+  if (fault && process_faults != NULL)
+    (*process_faults)[(*process_of)[reference]]++;
+  
+  if (sample == 0 || i % sample != 0)
+    return;
+  
+  if (sample > 1)
+  {
+    append(i, 0);
+    buffer += ": ";
+  }
+  
+  // Output frame state
+  append(source->page(reference), padding);
+  buffer += " -> ";
+  for (j = 0; j < num_frames; j++)
+  {
+    buffer += "| ";
+    if (j < frames.size())
+    {
+      append(source->page(frames[j]), padding);
+      buffer += ' ';
+    }
+    else
+    {
+      buffer.append(max(padding, 1) + 1, ' ');
+    }
+  }
+  buffer += '|';
+  if (fault)
+  {
+    buffer += " FAULT";
+  }
+  if (writeback)
+  {
+    buffer += " WRITE-BACK";
+  }
+  buffer += '\n';
+  
+  if (buffer.size() >= 1 << 16)
+    flush();
+}
+
+/***************************************************************************//**
+ * msim_output::finish
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Writes out anything still buffered followed by the summary of the run, if
+ * wanted: the number of page faults, the hit ratio and the time taken, and
+ * the number of write-backs for traces that record writes.
+ *
+ * Parameters:
+ * references - Number of references simulated.
+ * faults - Number of page faults that occurred.
+ * writebacks - Number of dirty pages evicted.
+ ******************************************************************************/
+void msim_output::finish(unsigned int references, unsigned int faults,
+  unsigned int writebacks)
+{
+  elapsed = chrono::duration<double>(chrono::steady_clock::now() - start)
+              .count();
+  this->writebacks = writebacks;
+  
+  flush();
+  if (!summary)
+    return;
+  
+  // Final output
+  if (sample != 0)
+    cout << "\n";
+  cout << "page faults: " << faults << "\n";
+  if (source->has_writes())
+    cout << "write-backs: " << writebacks << "\n";
+  cout << "hit ratio: " << fixed << setprecision(4)
+       << (references ? (double) (references - faults) / references : 0.0)
+       << "\n";
+  cout << "elapsed time: " << setprecision(6) << elapsed << " s"
+       << endl;
+  cout.unsetf(ios::floatfield);
+}
+
+/***************************************************************************//**
+ * msim_output::append
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Appends a right-aligned integer to the output buffer.
+ *
+ * Parameters:
+ * value - The integer to append.
+ * width - Minimum width of the field, padded with spaces on the left.
+ ******************************************************************************/
+void msim_output::append(long value, int width)
+{
+  char digits[24];
+  int length = 0;
+  unsigned long magnitude = value < 0 ? 0ul - value : value;
+  
+  // Build digits backwards
+  do
+  {
+    digits[length++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0)
+    digits[length++] = '-';
+  
+  if (width > length)
+    buffer.append(width - length, ' ');
+  while (length > 0)
+    buffer += digits[--length];
+}
+
+/***************************************************************************//**
+ * msim_output::flush
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Writes the buffered rows to standard output in one block.
+ ******************************************************************************/
+void msim_output::flush()
+{
+  cout.write(buffer.data(), buffer.size());
+  buffer.clear();
+}
+
+/***************************************************************************//**
+ * msim_ws
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates the working set policy, which keeps exactly the pages referenced
+ * in the last tau references resident, however many frames that takes. The
+ * window is slid one reference at a time: the reference leaving it takes its
+ * page out of the working set only if that page has not been referenced
+ * since, which the position of every page's latest reference tells in
+ * constant time. A page written while in the working set is written back
+ * when it leaves.
+ *
+ * Parameters:
+ * ref_string - trace of page ids supplied in the order in which the pages are
+ * accessed by the system.
+ * tau - Size of the window, in references.
+ *
+ * Returns:
+ * The page faults, write-backs and frames used by the run.
+ ******************************************************************************/
+msim_usage msim_ws(trace& ref_string, unsigned int tau)
+{
+  msim_usage usage;
+  vector<unsigned int> last(ref_string.distinct(), MSIM_NO_FRAME);
+  vector<char> dirty(ref_string.distinct(), 0);
+  unsigned int resident = 0;
+  double total = 0.0;
+  unsigned int i;
+  int page;
+  
+  for (i = 0; i < ref_string.size(); i++)
+  {
+    // The reference falling out of the window
+    if (i >= tau)
+    {
+      page = ref_string[i - tau];
+      if (last[page] == i - tau)
       {
-        cout << setw(padding) << " " << " ";
+        resident--;
+        if (dirty[page])
+        {
+          usage.writebacks++;
+          dirty[page] = 0;
+        }
       }
     }
-    cout << "|";
-    if (fault)
+    
+    page = ref_string[i];
+    if (last[page] == MSIM_NO_FRAME || i - last[page] >= tau)
     {
-      cout << " FAULT";
+      usage.faults++;
+      resident++;
     }
-    cout << endl;
+    last[page] = i;
+    if (ref_string.write(i))
+      dirty[page] = 1;
+    
+    total += resident;
+    usage.peak_frames = max(usage.peak_frames, resident);
   }
   
-  // Final output
-  cout << "\n";
-  cout << "page faults: " << faults << endl;
+  if (ref_string.size() > 0)
+    usage.mean_frames = total / ref_string.size();
+  return usage;
 }
 
 /***************************************************************************//**
- * msim_mfu
+ * msim_pff
  *
  * Author:
  * Daniel Andrus
  * 
  * Description:
- * Function to simulate a "most frequently used" page management algorithm.
- * Using a supplied reference string in the form of an integer vector and a
- * maximum number of frames available to the system, this function displays the
- * state of the memory frames at each stage of the simulation, highlighting
- * where page faults occur and keeping a running total of the number of page
- * faults that occur.
+ * Simulates the page fault frequency policy. On every page fault the time
+ * since the previous fault is compared with a threshold: a shorter interval
+ * means faults are too frequent, so the faulting page is simply added to the
+ * resident set; a longer one means the set is larger than needed, so every
+ * page not referenced since the previous fault is released first.
+ *
+ * Resident pages are kept on a recency list, so the pages not referenced
+ * since the previous fault are always at its head and releasing them costs
+ * only the pages released.
  *
  * Parameters:
- * ref_string - vector of integers supplied in the order in which the pages are
+ * ref_string - trace of page ids supplied in the order in which the pages are
  * accessed by the system.
- * num_frames - Maximum number of frames available to the simulation.
+ * threshold - Largest interval between faults, in references, at which the
+ * resident set keeps growing.
+ *
+ * Returns:
+ * The page faults, write-backs and frames used by the run.
  ******************************************************************************/
-void msim_mfu(vector<int>& ref_string, unsigned int num_frames)
+msim_usage msim_pff(trace& ref_string, unsigned int threshold)
 {
-  vector<int> frames;
-  auto frame = frames.end();
-  bool fault;
-  int faults = 0;
-  int padding = 0;
-  int temp;
+  msim_usage usage;
+  vector<lru_node> nodes(ref_string.distinct());
+  vector<unsigned int> last(ref_string.distinct(), MSIM_NO_FRAME);
+  vector<char> resident(ref_string.distinct(), 0);
+  vector<char> dirty(ref_string.distinct(), 0);
+  lru_list recency;
+  unsigned int count = 0;
+  unsigned int previous = 0;            // position of the previous fault
+  double total = 0.0;
   unsigned int i;
-  unsigned int j;
-  
-  vector<int> counts;
+  int page;
+  int stale;
   
-  // For formatting reasons, find 'widest' number
   for (i = 0; i < ref_string.size(); i++)
   {
-    // Handle positive and negative numbers differently
-    if (ref_string[i] < 0)
+    page = ref_string[i];
+    if (resident[page])
     {
-      temp = (int) (ceil(log10(-ref_string[i] + 1))) + 1;
+      recency.unlink(&nodes[page]);
     }
     else
     {
-      temp = (int) (ceil(log10(ref_string[i] + 1)));
-    }
-    
-    if (temp > padding) padding = temp;
-  }
-  
-  cout << right;
-  
-  // Work through reference string
-  for (i = 0; i < ref_string.size(); i++)
-  {
-    frame = find(frames.begin(), frames.end(), ref_string[i]);
-    fault = (frame == frames.end());
-    
-    // Check for page faults
-    if (fault)
-    {
-      // Handle page faults
-      faults++;
-        
-      // Check if we have spare space
-      if (frames.size() < num_frames)
-      {
-        // We have plenty of space, just stick it in there (lennyface.jpg)
-        frames.push_back(ref_string[i]);
-        counts.push_back(1);
-      }
-      else
+      // Faults are rare enough to shrink the resident set
+      if (usage.faults > 0 && i - previous > threshold)
       {
-        // Out of space, choose item to replace
-        frame = counts.begin();
-        
-        // Choose item with lowest count to replace
-        for (j = 0; j < counts.size(); j++)
+        while (recency.head != NULL
+               && last[stale = recency.head - nodes.data()] < previous)
         {
-          if (counts[j] > *frame)
+          recency.unlink(recency.head);
+          resident[stale] = 0;
+          count--;
+          if (dirty[stale])
           {
-            frame = counts.begin() + j;
+            usage.writebacks++;
+            dirty[stale] = 0;
           }
         }
-        
-        // Replace element at position frame
-        counts[frame - counts.begin()] = 1;
-        frames[frame - counts.begin()] = ref_string[i];
       }
+      usage.faults++;
+      previous = i;
+      resident[page] = 1;
+      count++;
     }
-    else
-    {
-      counts[frame - frames.begin()]++;
-    }
+    recency.push_back(&nodes[page]);
+    last[page] = i;
+    if (ref_string.write(i))
+      dirty[page] = 1;
     
-    // Output frame state
-    cout << setw(padding) << ref_string[i] << " -> ";
-    for (j = 0; j < num_frames; j++)
-    {
-      cout << "| ";
-      if (j < frames.size())
-      {
-        cout << setw(padding) << frames[j] << " ";
-      }
-      else
-      {
-        cout << setw(padding) << " " << " ";
-      }
-    }
-    cout << "|";
-    if (fault)
-    {
-      cout << " FAULT";
-    }
-    cout << endl;
+    total += count;
+    usage.peak_frames = max(usage.peak_frames, count);
   }
   
-  // Final output
-  cout << "\n";
-  cout << "page faults: " << faults << endl;
+  if (ref_string.size() > 0)
+    usage.mean_frames = total / ref_string.size();
+  return usage;
 }
 
 /***************************************************************************//**
- * msim_sc
+ * msim_variable
  *
  * Author:
  * Daniel Andrus
  * 
  * Description:
- * Function to simulate a "second chance" page management algorithm. Using
- * a supplied reference string in the form of an integer vector and a maximum
- * number of frames available to the system, this function displays the state of
- * the memory frames at each stage of the simulation, highlighting where page
- * faults occur and keeping a running total of the number of page faults that
- * occur.
+ * Runs the working set or page fault frequency policy for each value of its
+ * parameter in a range, in parallel on a work-stealing thread pool, and
+ * prints the page faults next to the average and peak number of frames each
+ * run used, showing what every fault saved costs in memory.
  *
  * Parameters:
- * ref_string - vector of integers supplied in the order in which the pages are
+ * alg - MSIM_WS or MSIM_PFF.
+ * ref_string - trace of page ids supplied in the order in which the pages are
  * accessed by the system.
- * num_frames - Maximum number of frames available to the simulation.
+ * first - Smallest window (ws) or threshold (pff).
+ * last - Largest window or threshold.
+ * step - Distance between successive values.
  ******************************************************************************/
-void msim_sc(vector<int>& ref_string, unsigned int num_frames)
+void msim_variable(int alg, trace& ref_string, unsigned int first,
+  unsigned int last, unsigned int step)
 {
-  vector<int> frames;
-  auto frame = frames.end();
-  bool fault;
-  int faults = 0;
-  int padding = 0;
-  int temp;
-  unsigned int i;
+  work_pool pool;
+  unsigned int num_values = (last - first) / step + 1;
+  vector<msim_usage> usage(num_values);
   unsigned int j;
   
-  vector<int> queue;          // FIFO vector that drives the algorithm
-  vector<int> refbit;
-  
-  // For formatting reasons, find 'widest' number
-  for (i = 0; i < ref_string.size(); i++)
+  for (j = 0; j < num_values; j++)
   {
-    // Handle positive and negative numbers differently
-    if (ref_string[i] < 0)
+    pool.submit([&, j]()
     {
-      temp = (int) (ceil(log10(-ref_string[i] + 1))) + 1;
-    }
-    else
-    {
-      temp = (int) (ceil(log10(ref_string[i] + 1)));
-    }
-    
-    if (temp > padding) padding = temp;
+      if (alg == MSIM_WS)
+        usage[j] = msim_ws(ref_string, first + j * step);
+      else
+        usage[j] = msim_pff(ref_string, first + j * step);
+    });
   }
+  pool.run();
   
+  // Output results
   cout << right;
+  cout << setw(10) << (alg == MSIM_WS ? "tau" : "threshold")
+       << setw(14) << "page faults";
+  if (ref_string.has_writes())
+    cout << setw(14) << "write-backs";
+  cout << setw(14) << "mean frames" << setw(14) << "peak frames" << "\n";
+  for (j = 0; j < num_values; j++)
+  {
+    cout << setw(10) << first + j * step << setw(14) << usage[j].faults;
+    if (ref_string.has_writes())
+      cout << setw(14) << usage[j].writebacks;
+    cout << fixed << setprecision(2) << setw(14) << usage[j].mean_frames
+         << setw(14) << usage[j].peak_frames << "\n";
+  }
+  cout.unsetf(ios::floatfield);
+  cout << flush;
+}
+
+/***************************************************************************//**
+ * msim_shards
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Estimates the LRU miss ratio curve from a spatial sample of the pages, in
+ * the manner of SHARDS. A page is sampled when its hash falls below a
+ * threshold, so every reference to it is seen or none is, and the stack
+ * distances among the sampled pages, scaled up by the sampling rate, stand in
+ * for the true ones. References to other pages cost a hash and a compare.
+ * The trace is read as a stream, a block at a time, and nothing is kept of
+ * it beyond the sampled pages, so it never has to fit in memory.
+ *
+ * With a fixed rate the sampled pages are a fixed fraction of all of them, and
+ * the count of sampled references is corrected towards its expected value.
+ * With a fixed number of sampled pages the threshold is lowered whenever one
+ * too many is sampled, dropping the pages with the largest hashes and scaling
+ * down what has been counted so far, so memory stays constant however long or
+ * wide the trace is.
+ *
+ * Stack distances come from Fenwick trees over the times of latest
+ * references, which are renumbered whenever they run out, keeping the trees
+ * proportional to the sampled pages. The sample is also split by hash into
+ * MSIM_SHARDS_GROUPS independent groups, each giving its own estimate; the
+ * spread of those estimates, shrunk as the rate nears 1, yields an
+ * approximate 95% bound on the error.
+ *
+ * Parameters:
+ * input - The trace to read, with page numbers in the order in which the
+ * pages are accessed by the system.
+ * first - Smallest number of frames to report.
+ * last - Largest number of frames to report.
+ * step - Distance between successive frame counts.
+ * rate - Fraction of the pages to sample, when sample_pages is 0.
+ * sample_pages - Number of pages to sample, or 0 to sample at a fixed rate.
+ ******************************************************************************/
+void msim_shards(trace_stream& input, unsigned int first, unsigned int last,
+  unsigned int step, double rate, unsigned int sample_pages)
+{
+  const unsigned int groups = MSIM_SHARDS_GROUPS;
+  const unsigned int all = groups;      // index of the whole sample
+  unordered_map<long long, shards_page> sampled;
+  priority_queue<pair<uint32_t, long long> > largest;   // fixed size only
+  vector<long long> pages;
+  vector<char> writes;
+  vector<vector<int> > trees(groups + 1);
+  vector<vector<double> > histogram(groups + 1,
+                                    vector<double>(last + 2, 0.0));
+  vector<double> total(groups + 1, 0.0);
+  vector<unsigned int> live(groups + 1, 0);
+  vector<shards_page*> order;
+  uint64_t threshold;
+  double weight = 1.0;                  // of a reference counted now
+  double scale;
+  double distance;
+  double expected;
+  double missed;
+  double mean;
+  double spread;
+  unsigned int capacity = 4096;
+  unsigned int clock = 1;
+  unsigned int stamp;
+  unsigned int count;
+  unsigned int f;
+  unsigned int k;
+  uint64_t hash;
+  uint32_t value;
+  unsigned long long references = 0;
+  unsigned long long sampled_refs = 0;
+  size_t block;                         // references in the block read
+  size_t i;
+  long long page;
   
-  // Work through reference string
-  for (i = 0; i < ref_string.size(); i++)
+  // Distances beyond the last frame count all share its final bucket
+  auto bucket = [last](double distance)
   {
-    frame = find(queue.begin(), queue.end(), ref_string[i]);
-    fault = (frame == queue.end());
-    
-    // Check for page faults
-    if (fault)
+    return distance > last ? last + 1 : (unsigned int) ceil(distance);
+  };
+  
+  threshold = MSIM_SHARDS_MODULUS;
+  if (sample_pages == 0)
+    threshold = max(1.0, floor(rate * MSIM_SHARDS_MODULUS + 0.5));
+  for (k = 0; k <= groups; k++)
+    trees[k].resize(capacity + 1, 0);
+  
+  // Only the pages read so far are known; the trace is never held whole
+  while ((block = trace_stream_read(input, pages, writes)) > 0)
+  {
+    references += block;
+    for (i = 0; i < block; i++)
     {
-      // Handle page faults
-      faults++;
-        
-      // Check if we have spare space
-      if (frames.size() < num_frames)
+      page = pages[i];
+      hash = frequency_sketch::hash(page);
+      value = hash & (MSIM_SHARDS_MODULUS - 1);
+      if (value >= threshold)
+        continue;
+      sampled_refs++;
+      
+      // Renumber the times of latest references once they run out
+      if (clock > capacity)
+      {
+        order.clear();
+        for (auto& entry : sampled)
+          order.push_back(&entry.second);
+        sort(order.begin(), order.end(),
+             [](const shards_page* a, const shards_page* b)
+             { return a->stamp < b->stamp; });
+        capacity = max(capacity, 2 * (unsigned int) order.size());
+        for (k = 0; k <= groups; k++)
+          trees[k].assign(capacity + 1, 0);
+        for (clock = 1; clock <= order.size(); clock++)
+        {
+          order[clock - 1]->stamp = clock;
+          fenwick_add(trees[all], clock, 1);
+          fenwick_add(trees[order[clock - 1]->group], clock, 1);
+        }
+      }
+      
+      // Each sampled page stands for 1 / rate pages, so a stack distance d
+      // among them is worth 1 + (d - 1) / rate pages
+      scale = (double) MSIM_SHARDS_MODULUS / threshold;
+      auto found = sampled.find(page);
+      if (found == sampled.end())
       {
-        // We have plenty of space, just stick it in there (lennyface.jpg)
-        frames.push_back(ref_string[i]);
+        shards_page& entry = sampled[page];
+        entry.group = (hash >> 32) % groups;
+        entry.value = value;
+        histogram[all][last + 1] += weight;
+        histogram[entry.group][last + 1] += weight;
+        live[all]++;
+        live[entry.group]++;
+        if (sample_pages != 0)
+          largest.push(make_pair(value, page));
+        found = sampled.find(page);
       }
       else
       {
-        // Out of space, find first item in queue not referenced
-        for (j = 0; j < refbit.size() && refbit[j] == 1; j++)
-        {
-          refbit[j] = 0;
-        }
-        if (j == refbit.size())
+        stamp = found->second.stamp;
+        k = found->second.group;
+        distance = 1 + (live[all] - fenwick_sum(trees[all], stamp)) * scale;
+        histogram[all][bucket(distance)] += weight;
+        distance = 1 + (live[k] - fenwick_sum(trees[k], stamp)) * scale
+                   * groups;
+        histogram[k][bucket(distance)] += weight;
+        fenwick_add(trees[all], stamp, -1);
+        fenwick_add(trees[k], stamp, -1);
+      }
+      total[all] += weight;
+      total[found->second.group] += weight;
+      found->second.stamp = clock;
+      fenwick_add(trees[all], clock, 1);
+      fenwick_add(trees[found->second.group], clock, 1);
+      clock++;
+      
+      // Too many pages sampled: lower the threshold past the largest hashes
+      // and scale down everything counted so far, by weighting what comes next
+      if (sample_pages != 0 && sampled.size() > sample_pages)
+      {
+        value = largest.top().first;
+        while (!largest.empty() && largest.top().first == value)
         {
-          j = 0;
+          found = sampled.find(largest.top().second);
+          k = found->second.group;
+          fenwick_add(trees[all], found->second.stamp, -1);
+          fenwick_add(trees[k], found->second.stamp, -1);
+          live[all]--;
+          live[k]--;
+          sampled.erase(found);
+          largest.pop();
         }
-        
-        frame = find(frames.begin(), frames.end(), queue[j]);
-        *frame = ref_string[i];
-        
-        // Update queue
-        refbit.erase(refbit.begin() + j);
-        queue.erase(queue.begin() + j);
+        weight *= (double) threshold / value;
+        threshold = value;
       }
-      queue.push_back(ref_string[i]);
-      refbit.push_back(0);
-    }
-    else
-    {
-      refbit[frame - queue.begin()] = 1;
     }
-    
-    // Output frame state
-    cout << setw(padding) << ref_string[i] << " -> ";
-    for (j = 0; j < num_frames; j++)
+  }
+  
+  // Bring a fixed rate sample to the number of references it should have
+  // seen; a fixed size one has no single rate to expect from
+  if (sample_pages == 0 && total[all] > 0)
+  {
+    expected = (double) references * threshold / MSIM_SHARDS_MODULUS;
+    for (k = 0; k <= groups; k++)
     {
-      cout << "| ";
-      if (j < frames.size())
+      if (total[k] > 0)
       {
-        cout << setw(padding) << frames[j] << " ";
+        histogram[k][0] += (k == all ? expected : expected / groups)
+                           - total[k];
+        total[k] = (k == all ? expected : expected / groups);
       }
-      else
+    }
+  }
+  
+  // Turn histograms into the faults each group expects at every frame count
+  for (k = 0; k <= groups; k++)
+  {
+    missed = 0.0;
+    for (f = last + 1; f >= 1; f--)
+    {
+      missed += histogram[k][f];
+      histogram[k][f] = (total[k] > 0 ? missed / total[k] : 0.0)
+                        * references;
+    }
+  }
+  
+  // Output curve
+  cout << "sampled " << sampled.size() << " pages at a rate of "
+       << (double) threshold / MSIM_SHARDS_MODULUS << ", "
+       << sampled_refs << " of " << references << " references\n";
+  cout << right;
+  cout << setw(10) << "frames" << setw(14) << "page faults"
+       << setw(14) << "error (+/-)" << "\n";
+  cout << fixed << setprecision(0);
+  for (f = first; f <= last; f += step)
+  {
+    // Mean and spread of the group estimates
+    mean = 0.0;
+    spread = 0.0;
+    count = 0;
+    for (k = 0; k < groups; k++)
+    {
+      if (total[k] > 0)
       {
-        cout << setw(padding) << " " << " ";
+        mean += histogram[k][f + 1];
+        count++;
       }
     }
-    cout << "|";
-    if (fault)
+    mean /= max(count, 1u);
+    for (k = 0; k < groups; k++)
     {
-      cout << " FAULT";
+      if (total[k] > 0)
+        spread += (histogram[k][f + 1] - mean) * (histogram[k][f + 1] - mean);
     }
-    cout << endl;
+    spread = (count > 1 ? 2 * sqrt(spread / (count - 1) / count
+                                   * (1 - (double) threshold
+                                          / MSIM_SHARDS_MODULUS)) : 0.0);
+    
+    cout << setw(10) << f << setw(14) << histogram[all][f + 1]
+         << setw(14) << spread << "\n";
   }
-  
-  // Final output
-  cout << "\n";
-  cout << "page faults: " << faults << endl;
+  cout.unsetf(ios::floatfield);
+  cout << flush;
 }
 
 /***************************************************************************//**
- * msim_c
+ * msim_streamable
  *
  * Author:
  * Daniel Andrus
  * 
  * Description:
- * Function to simulate a "clock" page management algorithm. Using
- * a supplied reference string in the form of an integer vector and a maximum
- * number of frames available to the system, this function displays the state of
- * the memory frames at each stage of the simulation, highlighting where page
- * faults occur and keeping a running total of the number of page faults that
- * occur.
+ * Tells whether an algorithm can simulate a trace as it is read. That takes
+ * a policy that never looks ahead and keeps state only for resident pages,
+ * since a stream offers neither the future nor a bound on the pages seen.
+ * SHARDS qualifies too, as it keeps state only for the pages it samples.
  *
  * Parameters:
- * ref_string - vector of integers supplied in the order in which the pages are
- * accessed by the system.
+ * alg - An msim_alg value.
+ *
+ * Returns:
+ * True if msim_stream, or msim_shards for shards, can run the algorithm.
+ ******************************************************************************/
+bool msim_streamable(int alg)
+{
+  return alg == MSIM_FIFO || alg == MSIM_LRU || alg == MSIM_LFU
+         || alg == MSIM_MFU || alg == MSIM_SC || alg == MSIM_C
+         || alg == MSIM_ESC || alg == MSIM_SHARDS;
+}
+
+/***************************************************************************//**
+ * msim_stream
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates an online page replacement policy on a trace as it is read,
+ * printing interval reports along the way and the totals at the end.
+ *
+ * Parameters:
+ * alg - An msim_alg value accepted by msim_streamable, other than shards.
+ * input - The trace to read.
  * num_frames - Maximum number of frames available to the simulation.
+ * tally - Receives the totals and prints the reports.
+ * config - Tuning knobs for the policy.
+ *
+ * Returns:
+ * False if the algorithm cannot be streamed, true otherwise.
  ******************************************************************************/
-void msim_c(vector<int>& ref_string, unsigned int num_frames)
+bool msim_stream(int alg, trace_stream& input, unsigned int num_frames,
+  msim_tally& tally, const policy_config& config)
 {
-  vector<int> frames;
-  auto frame = frames.end();
-  bool fault;
-  int faults = 0;
-  int padding = 0;
-  int temp;
-  unsigned int i;
-  unsigned int j;
+  trace window;
   
-  vector<int> refbit;
-  auto hand = refbit.end();
+  // Policies size their frame storage by the shorter of the frames and the
+  // trace, and a stream has no known length
+  window.count = (size_t) -1;
   
-  // For formatting reasons, find 'widest' number
-  for (i = 0; i < ref_string.size(); i++)
+  switch (alg)
   {
-    // Handle positive and negative numbers differently
-    if (ref_string[i] < 0)
-    {
-      temp = (int) (ceil(log10(-ref_string[i] + 1))) + 1;
-    }
-    else
-    {
-      temp = (int) (ceil(log10(ref_string[i] + 1)));
-    }
+  case MSIM_FIFO:
+  {
+    fifo_policy policy(window, num_frames, config);
+    msim_stream_run(input, num_frames, policy, window, tally);
+    return true;
+  }
     
-    if (temp > padding) padding = temp;
+  case MSIM_LRU:
+  {
+    lru_policy policy(window, num_frames, config);
+    msim_stream_run(input, num_frames, policy, window, tally);
+    return true;
+  }
+    
+  case MSIM_LFU:
+  {
+    lfu_policy policy(window, num_frames, config);
+    msim_stream_run(input, num_frames, policy, window, tally);
+    return true;
+  }
+    
+  case MSIM_MFU:
+  {
+    mfu_policy policy(window, num_frames, config);
+    msim_stream_run(input, num_frames, policy, window, tally);
+    return true;
+  }
+    
+  case MSIM_SC:
+  {
+    sc_policy policy(window, num_frames, config);
+    msim_stream_run(input, num_frames, policy, window, tally);
+    return true;
+  }
+    
+  case MSIM_C:
+  {
+    clock_policy policy(window, num_frames, config);
+    msim_stream_run(input, num_frames, policy, window, tally);
+    return true;
+  }
+    
+  case MSIM_ESC:
+  {
+    esc_policy policy(window, num_frames, config);
+    msim_stream_run(input, num_frames, policy, window, tally);
+    return true;
+  }
   }
   
-  cout << right;
+  return false;
+}
+
+/***************************************************************************//**
+ * msim_tally::report
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Prints the faults and hit ratio of the interval just completed, flushing
+ * them so they show up while the stream is still running.
+ ******************************************************************************/
+void msim_tally::report()
+{
+  unsigned long long length = (references - 1) % interval + 1;
   
-  // Work through reference string
-  for (i = 0; i < ref_string.size(); i++)
+  cout << "references " << references - length + 1 << "-" << references
+       << ": page faults " << interval_faults << ", hit ratio "
+       << fixed << setprecision(4)
+       << (double) (length - interval_faults) / length << endl;
+  cout.unsetf(ios::floatfield);
+  interval_faults = 0;
+}
+
+/***************************************************************************//**
+ * msim_tally::finish
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Reports the last, partial interval, if any, followed by the totals of the
+ * whole stream.
+ ******************************************************************************/
+void msim_tally::finish()
+{
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now()
+                                            - start).count();
+  
+  if (interval != 0 && references % interval != 0)
+    report();
+  
+  cout << "page faults: " << faults << "\n";
+  if (writes)
+    cout << "write-backs: " << writebacks << "\n";
+  cout << "hit ratio: " << fixed << setprecision(4)
+       << (references ? (double) (references - faults) / references : 0.0)
+       << "\n";
+  cout << "elapsed time: " << setprecision(6) << elapsed << " s" << endl;
+  cout.unsetf(ios::floatfield);
+}
+
+/***************************************************************************//**
+ * msim_processes
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates a page replacement policy on a trace of several processes and
+ * reports the references, frames and page faults of each process, followed by
+ * Jain's fairness index of their fault rates: 1 when every process faults at
+ * the same rate, down to 1 / n when one process takes all the faults.
+ *
+ * Under global replacement the policy runs once over every page of every
+ * process, so one process's references can evict another's pages, and a
+ * per-process tally of the faults is kept as the run goes. Under local
+ * replacement every process gets its own frames and its own instance of the
+ * policy, which never looks at other processes' pages; since the processes
+ * then cannot affect each other, each is simulated on its own trace, all of
+ * them in parallel on a work-stealing thread pool. Frames are split equally
+ * for fixed allocation, or in proportion to the number of pages each process
+ * uses for proportional allocation, every process getting at least one.
+ *
+ * Parameters:
+ * alg - An msim_alg value from MSIM_POLICIES.
+ * ref_string - trace of page ids remapped from the packed keys of
+ * trace_open_processes.
+ * num_frames - Number of frames shared by the processes.
+ * sharing - An msim_sharing value.
+ * config - Tuning knobs for the policy.
+ ******************************************************************************/
+void msim_processes(int alg, trace& ref_string, unsigned int num_frames,
+  int sharing, const policy_config& config)
+{
+  vector<int> pids;                     // process id of each process
+  vector<int> process_of;               // page id -> process
+  vector<size_t> first_id;              // first page id of each process
+  vector<size_t> references;
+  vector<unsigned int> frames;
+  vector<unsigned int> faults;
+  vector<unsigned int> writebacks;
+  work_pool pool;
+  msim_output out;
+  size_t num_procs;
+  size_t p;
+  size_t i;
+  unsigned int given;
+  unsigned int total_faults = 0;
+  unsigned int total_writebacks = 0;
+  vector<pair<double, int> > order;     // (remainder, -process)
+  double share;
+  double rate;
+  double sum = 0.0;
+  double squares = 0.0;
+  
+  // Ids are ordered by key, so each process owns a run of consecutive ids
+  process_of.resize(ref_string.distinct());
+  for (i = 0; i < ref_string.distinct(); i++)
   {
-    frame = find(frames.begin(), frames.end(), ref_string[i]);
-    fault = (frame == frames.end());
-    
-    // Check for page faults
-    if (fault)
+    if (pids.empty() || trace_key_pid(ref_string.pages[i]) != pids.back())
     {
-      // Handle page faults
-      faults++;
-        
-      // Check if we have spare space
-      if (frames.size() < num_frames)
-      {
-        // We have plenty of space, just stick it in there (lennyface.jpg)
-        frames.push_back(ref_string[i]);
-        refbit.push_back(0);
-        hand = refbit.end() - 1;
-      }
-      else
-      {
-        // Out of space, move hand until we find unreferenced item
-        while (*hand == 1)
-        {
-          *hand = 0;
-          hand++;
-          if (hand == refbit.end())
-          {
-            hand = refbit.begin();
-          }
-        }
-        
-        frame = frames.begin() + (hand - refbit.begin());
-        *frame = ref_string[i];
-      }
+      pids.push_back(trace_key_pid(ref_string.pages[i]));
+      first_id.push_back(i);
     }
-    else
+    process_of[i] = pids.size() - 1;
+  }
+  num_procs = pids.size();
+  if (num_procs == 0)
+  {
+    cout << "No references to simulate" << endl;
+    return;
+  }
+  first_id.push_back(ref_string.distinct());
+  references.resize(num_procs, 0);
+  for (i = 0; i < ref_string.size(); i++)
+    references[process_of[ref_string[i]]]++;
+  
+  faults.resize(num_procs, 0);
+  writebacks.resize(num_procs, 0);
+  frames.resize(num_procs, 0);
+  if (sharing != MSIM_GLOBAL && num_frames < num_procs)
+  {
+    cout << "Local replacement needs a frame for each of the " << num_procs
+         << " processes" << endl;
+    return;
+  }
+  
+  if (sharing == MSIM_GLOBAL)
+  {
+    // One run over everything, tallying faults by process
+    out.sample = 0;
+    out.summary = false;
+    out.process_of = &process_of;
+    out.process_faults = &faults;
+    msim_simulate(alg, ref_string, num_frames, out, config);
+    total_writebacks = out.writebacks;
+  }
+  else
+  {
+    // Split the frames: one each, then the rest equally or by pages used,
+    // frames left over from rounding down going to the largest remainders
+    given = num_procs;
+    for (p = 0; p < num_procs; p++)
     {
-      hand = refbit.begin() + (frame - frames.begin());
-      *hand = 1;
+      share = (double) (num_frames - num_procs)
+              * (sharing == MSIM_FIXED ? 1.0 / num_procs
+                 : (double) (first_id[p + 1] - first_id[p])
+                   / ref_string.distinct());
+      frames[p] = 1 + (unsigned int) share;
+      given += frames[p] - 1;
+      order.push_back(make_pair(share - floor(share), -(int) p));
     }
+    sort(order.rbegin(), order.rend());
+    for (p = 0; given < num_frames; p++, given++)
+      frames[-order[p].second]++;
     
-    // Output frame state
-    cout << setw(padding) << ref_string[i] << " -> ";
-    for (j = 0; j < num_frames; j++)
+    // Every process on its own, with ids local to it
+    vector<trace> local(num_procs);
+    for (p = 0; p < num_procs; p++)
     {
-      cout << "| ";
-      if (j < frames.size())
-      {
-        cout << setw(padding) << frames[j] << " ";
-      }
-      else
-      {
-        cout << setw(padding) << " " << " ";
-      }
+      local[p].storage.reserve(references[p]);
+      local[p].pages.assign(ref_string.pages.begin() + first_id[p],
+                            ref_string.pages.begin() + first_id[p + 1]);
+    }
+    for (i = 0; i < ref_string.size(); i++)
+    {
+      p = process_of[ref_string[i]];
+      local[p].storage.push_back(ref_string[i] - first_id[p]);
+      if (ref_string.has_writes())
+        local[p].writes.push_back(ref_string.write(i));
     }
-    cout << "|";
-    if (fault)
+    for (p = 0; p < num_procs; p++)
     {
-      cout << " FAULT";
+      local[p].data = local[p].storage.data();
+      local[p].count = local[p].storage.size();
+      if (find(local[p].writes.begin(), local[p].writes.end(), 1)
+          == local[p].writes.end())
+        local[p].writes.clear();
+      pool.submit([&, p]()
+      {
+        msim_output quiet;
+        
+        quiet.sample = 0;
+        quiet.summary = false;
+        faults[p] = msim_simulate(alg, local[p], frames[p], quiet, config);
+        writebacks[p] = quiet.writebacks;
+      });
     }
-    cout << endl;
+    pool.run();
+    for (p = 0; p < num_procs; p++)
+      total_writebacks += writebacks[p];
   }
   
-  // Final output
-  cout << "\n";
-  cout << "page faults: " << faults << endl;
+  // Output per-process results
+  cout << right;
+  cout << setw(10) << "process" << setw(14) << "references";
+  if (sharing != MSIM_GLOBAL)
+    cout << setw(10) << "frames";
+  cout << setw(14) << "page faults" << setw(12) << "fault rate" << "\n";
+  for (p = 0; p < num_procs; p++)
+  {
+    rate = (double) faults[p] / references[p];
+    sum += rate;
+    squares += rate * rate;
+    total_faults += faults[p];
+    
+    cout << setw(10) << pids[p] << setw(14) << references[p];
+    if (sharing != MSIM_GLOBAL)
+      cout << setw(10) << frames[p];
+    cout << setw(14) << faults[p] << fixed << setprecision(4) << setw(12)
+         << rate << "\n";
+    cout.unsetf(ios::floatfield);
+  }
+  
+  // Totals and Jain's index
+  cout << "page faults: " << total_faults << "\n";
+  if (ref_string.has_writes())
+    cout << "write-backs: " << total_writebacks << "\n";
+  cout << "fairness: " << fixed << setprecision(4)
+       << (squares > 0 ? sum * sum / (num_procs * squares) : 1.0) << endl;
+  cout.unsetf(ios::floatfield);
 }
 
+/***************************************************************************//**
+ * msim_hierarchy
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates a page replacement policy with every reference passing through a
+ * set-associative TLB, then memory, then swap, and reports how many lookups
+ * each level answered along with the effective access time.
+ *
+ * Every reference costs a TLB lookup and the memory access itself. A TLB miss
+ * adds a page table walk, one more memory access, and a page fault adds
+ * reading the page in from swap, as does every write-back of a dirty victim.
+ *
+ * Parameters:
+ * alg - An msim_alg value from MSIM_POLICIES.
+ * ref_string - trace of page ids supplied in the order in which the pages are
+ * accessed by the system.
+ * num_frames - Number of frames of memory.
+ * entries - Number of entries in the TLB.
+ * ways - Associativity of the TLB, dividing entries into a power of two sets.
+ * times - Access times in nanoseconds of the TLB, of memory and of swap.
+ * out - Output settings controlling how much of each step is displayed.
+ * config - Tuning knobs for the policy.
+ ******************************************************************************/
+void msim_hierarchy(int alg, trace& ref_string, unsigned int num_frames,
+  unsigned int entries, unsigned int ways, const double times[3],
+  msim_output& out, const policy_config& config)
+{
+  msim_tlb tlb(entries, ways);
+  unsigned long long references = ref_string.size();
+  unsigned long long faults;
+  unsigned long long walks;
+  unsigned long long transfers;
+  double access;
+  
+  out.tlb = &tlb;
+  faults = msim_simulate(alg, ref_string, num_frames, out, config);
+  out.tlb = NULL;
+  walks = tlb.misses;
+  transfers = faults + out.writebacks;
+  
+  // Output per-level results
+  cout << "\n" << right;
+  cout << setw(10) << "level" << setw(14) << "lookups" << setw(14) << "hits"
+       << setw(14) << "misses" << setw(12) << "hit ratio" << "\n";
+  cout << setw(10) << "tlb" << setw(14) << references << setw(14) << tlb.hits
+       << setw(14) << walks << fixed << setprecision(4) << setw(12)
+       << (references ? (double) tlb.hits / references : 0.0) << "\n";
+  cout << setw(10) << "memory" << setw(14) << walks << setw(14)
+       << walks - faults << setw(14) << faults << setw(12)
+       << (walks ? (double) (walks - faults) / walks : 0.0) << "\n";
+  cout.unsetf(ios::floatfield);
+  cout << setw(10) << "swap" << setw(14) << faults << setw(14) << faults
+       << "\n";
+  if (ref_string.has_writes())
+    cout << "swap writes: " << out.writebacks << "\n";
+  
+  // Every reference pays for the TLB and memory, misses for more below
+  access = references == 0 ? 0.0
+           : times[0] + times[1]
+             + ((double) walks * times[1] + (double) transfers * times[2])
+               / references;
+  cout << "effective access time: " << fixed << setprecision(2) << access
+       << " ns" << endl;
+  cout.unsetf(ios::floatfield);
+}
@@ -18,20 +18,672 @@
 #include <iomanip>
 #include <cstring>
 #include <vector>
+#include <unordered_map>
 #include <string>
 #include <cmath>
+#include <chrono>
+#include "trace.h"
+#include "policy.h"
+#include "lookup.h"
 
 using namespace std;
 
+struct msim_tlb;
+
+/*******************************************************************************
+ * Controls and buffers the per-reference frame table printed by the msim_run
+ * driver. Rows are formatted into an in-memory buffer that is written out
+ * in large blocks rather than flushed line by line. A sample of 0 suppresses
+ * the table entirely, leaving only the summary, while a sample of n > 1 prints
+ * every nth reference. Turning off summary also drops the closing report, for
+ * callers that collect the results themselves; elapsed and writebacks hold
+ * the time taken by and the write-backs of the last run either way. Given
+ * process_of, the process index of every page id, faults are also tallied per
+ * process into process_faults. Given a tlb, every lookup goes through it
+ * first.
+ ******************************************************************************/
+struct msim_output
+{
+  unsigned int sample;
+  unsigned int num_frames;
+  int padding;
+  string buffer;
+  bool summary;
+  double elapsed;
+  unsigned int writebacks;
+  chrono::steady_clock::time_point start;
+  const trace* source;          // trace whose page numbers are shown
+  const vector<int>* process_of;
+  vector<unsigned int>* process_faults;
+  msim_tlb* tlb;
+
+  msim_output() : sample(1), num_frames(0), padding(0), summary(true),
+    elapsed(0.0), writebacks(0), source(NULL), process_of(NULL),
+    process_faults(NULL), tlb(NULL) {}
+  void begin(trace& ref_string, unsigned int num_frames);
+  void step(unsigned int i, int reference, vector<int>& frames, bool fault,
+    bool writeback);
+  void finish(unsigned int references, unsigned int faults,
+    unsigned int writebacks);
+  void append(long value, int width);
+  void flush();
+};
+
+/*******************************************************************************
+ * Outcome of a run whose resident set grows and shrinks, as under the working
+ * set and page fault frequency modes. mean_frames averages the size of the
+ * resident set after every reference, and peak_frames is its largest size.
+ ******************************************************************************/
+struct msim_usage
+{
+  unsigned int faults;
+  unsigned int writebacks;
+  double mean_frames;
+  unsigned int peak_frames;
+
+  msim_usage() : faults(0), writebacks(0), mean_frames(0.0), peak_frames(0) {}
+};
+
+// References between interval reports of a streamed simulation by default
+#define MSIM_STREAM_INTERVAL 1000000
+
+/*******************************************************************************
+ * Running totals of a streamed simulation. Every interval references a line
+ * with the faults and hit ratio of just that interval is printed, so a live
+ * trace can be watched as it is simulated; an interval of 0 reports only the
+ * totals at the end.
+ ******************************************************************************/
+struct msim_tally
+{
+  unsigned long long interval;
+  unsigned long long references;
+  unsigned long long faults;
+  unsigned long long writebacks;
+  unsigned long long interval_faults;
+  bool writes;                  // whether any reference was a write
+  chrono::steady_clock::time_point start;
+
+  msim_tally(unsigned long long interval) : interval(interval),
+    references(0), faults(0), writebacks(0), interval_faults(0),
+    writes(false), start(chrono::steady_clock::now()) {}
+  void count(bool fault, bool writeback)
+  {
+    references++;
+    faults += fault;
+    interval_faults += fault;
+    writebacks += writeback;
+    if (interval != 0 && references % interval == 0)
+      report();
+  }
+  void report();
+  void finish();
+};
+
+/*******************************************************************************
+ * A page sampled by msim_shards: the time of its latest reference, the group
+ * it counts towards and the hash value that decided it was sampled.
+ ******************************************************************************/
+struct shards_page
+{
+  unsigned int stamp;
+  unsigned int group;
+  uint32_t value;
+};
+
+/*******************************************************************************
+ * A bare FIFO simulation that is advanced one reference at a time, used where
+ * several FIFO runs are compared reference by reference. FIFO fills frames in
+ * order and then always replaces the frame after the one it replaced last, so
+ * a single hand is all the queue it needs.
+ ******************************************************************************/
+struct fifo_sim
+{
+  vector<int> frames;
+  vector<unsigned int> slot_of;         // page -> frame holding it
+  unsigned int num_frames;
+  unsigned int hand;
+  unsigned int faults;
+
+  fifo_sim(unsigned int num_frames, size_t num_pages);
+  void preload(trace& ref_string, vector<unsigned int>& first_seen);
+  bool step(int page);
+};
+
+// Frame of a page that is not resident
+#define MSIM_NO_FRAME 0xffffffffu
+
+// Scanning the frames instead of the page table pays off only with few frames
+// and a table too large to stay in cache, so it is an optimisation for large
+// traces alone. Whole runs of fifo, lru and c at 4 to 64 frames put the
+// crossover near 2^19 distinct pages; below it the table wins at every frame
+// count, and "msim bench" shows the same for the lookups on their own
+#define MSIM_SCAN_FRAMES 64
+#define MSIM_SCAN_PAGES (1 << 19)
+
+// SHARDS samples a page when the low bits of its hash fall below a threshold
+// out of MSIM_SHARDS_MODULUS, and splits the sample into MSIM_SHARDS_GROUPS
+// independent groups by the high bits to estimate its error
+#define MSIM_SHARDS_MODULUS (1u << 24)
+#define MSIM_SHARDS_GROUPS 8
+#define MSIM_SHARDS_RATE 0.01
+
+/*******************************************************************************
+ * Residency indexes used by the msim_run driver to find the frame holding a
+ * page. Both answer find(page) with the frame or MSIM_NO_FRAME and are told of
+ * every page loaded into or evicted from a frame.
+ *
+ * table_index keeps the frame of every page id in a flat table, a single load
+ * per lookup however many frames there are, but one that misses the cache on
+ * traces with many pages. scan_index instead keeps the page of every frame in
+ * a short padded array searched by the widest lookup kernel the processor
+ * supports, which stays in cache and wins while the frames are few.
+ ******************************************************************************/
+struct table_index
+{
+  vector<unsigned int> slot_of;         // page -> frame holding it
+
+  table_index(size_t num_pages, unsigned int num_frames)
+    : slot_of(num_pages, MSIM_NO_FRAME) {}
+  unsigned int find(int page) const { return slot_of[page]; }
+  void insert(int page, unsigned int slot) { slot_of[page] = slot; }
+  void erase(int page) { slot_of[page] = MSIM_NO_FRAME; }
+};
+
+struct scan_index
+{
+  vector<int> keys;             // page in each frame, -1 if none
+  lookup_kernel kernel;
+
+  scan_index(size_t num_pages, unsigned int num_frames)
+    : keys((num_frames + LOOKUP_BLOCK - 1) / LOOKUP_BLOCK * LOOKUP_BLOCK, -1),
+      kernel(lookup_select()) {}
+  unsigned int find(int page) const
+  {
+    unsigned int slot = kernel(keys.data(), keys.size(), page);
+    return slot < keys.size() ? slot : MSIM_NO_FRAME;
+  }
+  void insert(int page, unsigned int slot) { keys[slot] = page; }
+  void erase(int page) {}       // the frame is overwritten by the next insert
+};
+
+/*******************************************************************************
+ * Residency index over raw page numbers, for traces whose pages are not known
+ * ahead of time or were left unmapped. An open addressing table at most half
+ * full, probed linearly from a Fibonacci hash of the page; erasing shifts
+ * later entries of the probe run back, so no tombstones build up over a long
+ * stream.
+ ******************************************************************************/
+struct hash_index
+{
+  vector<long long> keys;
+  vector<unsigned int> slots;   // frame of each entry, MSIM_NO_FRAME if empty
+  size_t mask;
+  unsigned int shift;
+
+  hash_index(size_t num_pages, unsigned int num_frames)
+    : mask(15), shift(60)
+  {
+    while (mask + 1 < 2 * (size_t) num_frames)
+    {
+      mask = 2 * mask + 1;
+      shift--;
+    }
+    keys.resize(mask + 1);
+    slots.resize(mask + 1, MSIM_NO_FRAME);
+  }
+  size_t home(long long page) const
+  {
+    return ((uint64_t) page * 0x9e3779b97f4a7c15ull) >> shift;
+  }
+  unsigned int find(long long page) const
+  {
+    size_t i;
+
+    for (i = home(page); slots[i] != MSIM_NO_FRAME; i = (i + 1) & mask)
+    {
+      if (keys[i] == page)
+        return slots[i];
+    }
+    return MSIM_NO_FRAME;
+  }
+  void insert(long long page, unsigned int slot)
+  {
+    size_t i;
+
+    for (i = home(page); slots[i] != MSIM_NO_FRAME; i = (i + 1) & mask) {}
+    keys[i] = page;
+    slots[i] = slot;
+  }
+  void erase(long long page)
+  {
+    size_t i = home(page);
+    size_t j;
+    size_t k;
+
+    while (keys[i] != page || slots[i] == MSIM_NO_FRAME)
+      i = (i + 1) & mask;
+
+    // Pull back entries that can no longer be reached past the gap
+    for (j = (i + 1) & mask; slots[j] != MSIM_NO_FRAME; j = (j + 1) & mask)
+    {
+      k = home(keys[j]);
+      if (((j - k) & mask) >= ((j - i) & mask))
+      {
+        keys[i] = keys[j];
+        slots[i] = slots[j];
+        i = j;
+      }
+    }
+    slots[i] = MSIM_NO_FRAME;
+  }
+};
+
+// Default TLB associativity, and the default access times in nanoseconds of
+// the TLB, of memory and of servicing a fault from swap
+#define MSIM_TLB_WAYS 4
+#define MSIM_TLB_TIME 1.0
+#define MSIM_MEMORY_TIME 100.0
+#define MSIM_SWAP_TIME 8000000.0
+
+/*******************************************************************************
+ * A set-associative translation lookaside buffer over page ids. The entries
+ * of all sets lie in two flat arrays, the tags and the frames they translate
+ * to, with the ways of each set side by side and kept in order from most to
+ * least recently used, so a lookup scans a few adjacent words and replacement
+ * is true LRU within the set. The set is picked by the low bits of the page
+ * id; remapping keeps pages in order, so neighbouring pages fall in
+ * neighbouring sets as they would by virtual page number.
+ ******************************************************************************/
+struct msim_tlb
+{
+  vector<int> tags;             // page in each entry, -1 if empty
+  vector<unsigned int> slots;   // frame each entry translates to
+  unsigned int ways;
+  unsigned int set_mask;
+  unsigned long long hits;
+  unsigned long long misses;
+
+  msim_tlb(unsigned int entries, unsigned int ways) : tags(entries, -1),
+    slots(entries, MSIM_NO_FRAME), ways(ways), set_mask(entries / ways - 1),
+    hits(0), misses(0) {}
+  size_t set(int page) const { return (size_t) (page & set_mask) * ways; }
+  bool find(int page, unsigned int& slot)
+  {
+    size_t base = set(page);
+    unsigned int way;
+
+    for (way = 0; way < ways; way++)
+    {
+      if (tags[base + way] == page)
+      {
+        slot = slots[base + way];
+        move(base, way, page, slot);
+        hits++;
+        return true;
+      }
+    }
+    misses++;
+    return false;
+  }
+  void insert(int page, unsigned int slot)
+  {
+    move(set(page), ways - 1, page, slot);
+  }
+  void erase(int page)
+  {
+    size_t base = set(page);
+    unsigned int way;
+
+    for (way = 0; way < ways && tags[base + way] != page; way++) {}
+    if (way == ways)
+      return;
+    for (; way + 1 < ways; way++)
+    {
+      tags[base + way] = tags[base + way + 1];
+      slots[base + way] = slots[base + way + 1];
+    }
+    tags[base + way] = -1;
+    slots[base + way] = MSIM_NO_FRAME;
+  }
+
+  // Shifts the ways ahead of the given one back a place and puts the entry
+  // first, dropping whatever was in that way
+  void move(size_t base, unsigned int way, int page, unsigned int slot)
+  {
+    for (; way > 0; way--)
+    {
+      tags[base + way] = tags[base + way - 1];
+      slots[base + way] = slots[base + way - 1];
+    }
+    tags[base] = page;
+    slots[base] = slot;
+  }
+};
+
+/*******************************************************************************
+ * Residency index that puts a TLB in front of another. A TLB hit answers with
+ * the cached frame without consulting the index behind it, the page table; a
+ * miss walks the table and loads the translation into the TLB. Evicting a page
+ * also shoots its translation down, so the TLB never names a stale frame.
+ ******************************************************************************/
+template <class Index>
+struct tlb_index
+{
+  Index table;
+  msim_tlb& tlb;
+
+  tlb_index(msim_tlb& tlb, size_t num_pages, unsigned int num_frames)
+    : table(num_pages, num_frames), tlb(tlb) {}
+  unsigned int find(int page)
+  {
+    unsigned int slot;
+
+    if (tlb.find(page, slot))
+      return slot;
+    slot = table.find(page);
+    if (slot != MSIM_NO_FRAME)
+      tlb.insert(page, slot);
+    return slot;
+  }
+  void insert(int page, unsigned int slot)
+  {
+    table.insert(page, slot);
+    tlb.insert(page, slot);
+  }
+  void erase(int page)
+  {
+    table.erase(page);
+    tlb.erase(page);
+  }
+};
+
+// How frames are shared among the processes of a multi-process trace
+enum msim_sharing
+{
+  MSIM_GLOBAL,                  // one pool; any process's page can be evicted
+  MSIM_FIXED,                   // equal partitions, replacement within each
+  MSIM_PROPORTIONAL             // partitions sized by each process's pages
+};
+
+// Algorithms understood by msim
+enum msim_alg
+{
+  MSIM_FIFO,
+  MSIM_OPT,
+  MSIM_LRU,
+  MSIM_LFU,
+  MSIM_SC,
+  MSIM_C,
+  MSIM_MFU,
+  MSIM_ESC,
+  MSIM_ARC,
+  MSIM_CAR,
+  MSIM_LIRS,
+  MSIM_CLOCKPRO,
+  MSIM_TINYLFU,
+  MSIM_WS,
+  MSIM_PFF,
+  MSIM_SHARDS,
+  MSIM_MRC,
+  MSIM_ALL,
+  MSIM_BELADY
+};
+
+extern const int MSIM_POLICIES[];
+extern const unsigned int MSIM_NUM_POLICIES;
+
 int msim(int argc, char*argv[]);
+int msim_parse_alg(const char* name);
+const char* msim_alg_name(int alg);
+
+unsigned int msim_simulate(int alg, trace& ref_string, unsigned int num_frames,
+  msim_output& out, const policy_config& config);
+void msim_mrc(trace& ref_string, unsigned int num_frames);
+void msim_all(trace& ref_string, unsigned int num_frames,
+  const policy_config& config);
+void msim_sweep(trace& ref_string, vector<int>& algs, unsigned int first,
+  unsigned int last, unsigned int step, const policy_config& config,
+  ostream& fout);
+
+void msim_belady(trace& ref_string, unsigned int first, unsigned int last,
+  unsigned int step);
+msim_usage msim_ws(trace& ref_string, unsigned int tau);
+msim_usage msim_pff(trace& ref_string, unsigned int threshold);
+void msim_variable(int alg, trace& ref_string, unsigned int first,
+  unsigned int last, unsigned int step);
+void msim_shards(trace_stream& input, unsigned int first, unsigned int last,
+  unsigned int step, double rate, unsigned int sample_pages);
+void msim_processes(int alg, trace& ref_string, unsigned int num_frames,
+  int sharing, const policy_config& config);
+void msim_hierarchy(int alg, trace& ref_string, unsigned int num_frames,
+  unsigned int entries, unsigned int ways, const double times[3],
+  msim_output& out, const policy_config& config);
+bool msim_streamable(int alg);
+bool msim_stream(int alg, trace_stream& input, unsigned int num_frames,
+  msim_tally& tally, const policy_config& config);
+void msim_bench(unsigned int num_pages, unsigned int lookups);
+
+void fenwick_add(vector<int>& tree, unsigned int pos, int value);
+int fenwick_sum(vector<int>& tree, unsigned int pos);
+
+template <class Index, class Policy>
+unsigned int msim_drive(trace& ref_string, unsigned int num_frames,
+  Policy& policy, msim_output& out, Index& index);
+
+/***************************************************************************//**
+ * msim_run
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates a page replacement policy over a remapped reference string. The
+ * driver owns the frames and an index of the frame holding each resident
+ * page, and defers to the policy only to keep its bookkeeping and to choose
+ * victims. Free frames are always filled in order before the policy is asked
+ * for a victim. The state of the frames at each step goes to the supplied
+ * output, followed by a summary of the run.
+ *
+ * Every frame also carries a dirty bit, set when its page is written. Evicting
+ * a dirty page counts as a write-back; pages still dirty when the trace ends
+ * are not counted.
+ *
+ * The Index type is the residency index to use, table_index or scan_index.
+ * When the output carries a TLB, the index is put behind it.
+ *
+ * Parameters:
+ * ref_string - trace of page ids supplied in the order in which the pages are
+ * accessed by the system.
+ * num_frames - Maximum number of frames available to the simulation.
+ * policy - The page replacement policy to simulate.
+ * out - Output settings controlling how much of each step is displayed.
+ *
+ * Returns:
+ * Number of page faults that occurred.
+ ******************************************************************************/
+template <class Index, class Policy>
+unsigned int msim_run(trace& ref_string, unsigned int num_frames,
+  Policy& policy, msim_output& out)
+{
+  if (out.tlb != NULL)
+  {
+    tlb_index<Index> index(*out.tlb, ref_string.distinct(), num_frames);
+    return msim_drive(ref_string, num_frames, policy, out, index);
+  }
+  
+  Index index(ref_string.distinct(), num_frames);
+  return msim_drive(ref_string, num_frames, policy, out, index);
+}
+
+/***************************************************************************//**
+ * msim_drive
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * The simulation loop behind msim_run, working through the given residency
+ * index.
+ *
+ * Parameters:
+ * ref_string - trace of page ids supplied in the order in which the pages are
+ * accessed by the system.
+ * num_frames - Maximum number of frames available to the simulation.
+ * policy - The page replacement policy to simulate.
+ * out - Output settings controlling how much of each step is displayed.
+ * index - Empty residency index to track the frames through.
+ *
+ * Returns:
+ * Number of page faults that occurred.
+ ******************************************************************************/
+template <class Index, class Policy>
+unsigned int msim_drive(trace& ref_string, unsigned int num_frames,
+  Policy& policy, msim_output& out, Index& index)
+{
+  vector<int> frames;
+  vector<char> dirty;                   // frame -> page written since loaded
+  bool fault;
+  bool write;
+  bool writeback;
+  unsigned int faults = 0;
+  unsigned int writebacks = 0;
+  unsigned int slot;
+  int page;
+  size_t i;
+  
+  out.begin(ref_string, num_frames);
+  
+  // Work through reference string
+  for (i = 0; i < ref_string.size(); i++)
+  {
+    page = ref_string[i];
+    write = ref_string.write(i);
+    slot = index.find(page);
+    fault = (slot == MSIM_NO_FRAME);
+    writeback = false;
+    
+    // Check for page faults
+    if (fault)
+    {
+      // Handle page faults
+      faults++;
+      
+      // Fill spare frames first, then let the policy pick a victim
+      if (frames.size() < num_frames)
+      {
+        slot = frames.size();
+        frames.push_back(page);
+        dirty.push_back(write);
+      }
+      else
+      {
+        slot = policy.choose_victim(i);
+        index.erase(frames[slot]);
+        frames[slot] = page;
+        writeback = dirty[slot];
+        writebacks += writeback;
+        dirty[slot] = write;
+      }
+      index.insert(page, slot);
+      policy.on_miss(slot, i);
+    }
+    else
+    {
+      dirty[slot] |= write;
+      policy.on_hit(slot, i);
+    }
+    
+    out.step(i, page, frames, fault, writeback);
+  }
+  
+  // Final output
+  out.finish(ref_string.size(), faults, writebacks);
+  return faults;
+}
 
-void msim_fifo(vector<int>& ref_string, unsigned int num_frames);
-void msim_opt(vector<int>& ref_string, unsigned int num_frames);
-void msim_lru(vector<int>& ref_string, unsigned int num_frames);
-void msim_lfu(vector<int>& ref_string, unsigned int num_frames);
-void msim_mfu(vector<int>& ref_string, unsigned int num_frames);
-void msim_sc(vector<int>& ref_string, unsigned int num_frames);
-void msim_c(vector<int>& ref_string, unsigned int num_frames);
+/***************************************************************************//**
+ * msim_stream_run
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Simulates a page replacement policy on a trace read as it arrives, block by
+ * block, in the manner of msim_run. Nothing is known about pages ahead of
+ * time, so resident pages are found through a hash_index keyed by page
+ * number, and memory is bounded by the number of frames rather than by the
+ * trace.
+ *
+ * The policy is handed a window onto the current block in place of the whole
+ * trace: only its write flags are filled in, positions count from the start
+ * of the block, and it holds no page ids. Only policies whose state lives in
+ * the frames, those msim_stream runs, can work from it.
+ *
+ * Parameters:
+ * input - The trace to read.
+ * num_frames - Maximum number of frames available to the simulation.
+ * policy - The page replacement policy to simulate, built on window.
+ * window - Trace the policy was built on.
+ * tally - Receives the totals and prints interval reports.
+ ******************************************************************************/
+template <class Policy>
+void msim_stream_run(trace_stream& input, unsigned int num_frames,
+  Policy& policy, trace& window, msim_tally& tally)
+{
+  hash_index index(0, num_frames);
+  vector<long long> frames;
+  vector<char> dirty;                   // frame -> page written since loaded
+  vector<long long> pages;
+  bool fault;
+  bool write;
+  bool writeback;
+  unsigned int slot;
+  size_t count;
+  size_t i;
+  
+  while ((count = trace_stream_read(input, pages, window.writes)) > 0)
+  {
+    window.count = count;
+    tally.writes = tally.writes || window.has_writes();
+    for (i = 0; i < count; i++)
+    {
+      write = window.write(i);
+      slot = index.find(pages[i]);
+      fault = (slot == MSIM_NO_FRAME);
+      writeback = false;
+      
+      if (fault)
+      {
+        // Fill spare frames first, then let the policy pick a victim
+        if (frames.size() < num_frames)
+        {
+          slot = frames.size();
+          frames.push_back(pages[i]);
+          dirty.push_back(write);
+        }
+        else
+        {
+          slot = policy.choose_victim(i);
+          index.erase(frames[slot]);
+          frames[slot] = pages[i];
+          writeback = dirty[slot];
+          dirty[slot] = write;
+        }
+        index.insert(pages[i], slot);
+        policy.on_miss(slot, i);
+      }
+      else
+      {
+        dirty[slot] |= write;
+        policy.on_hit(slot, i);
+      }
+      
+      tally.count(fault, writeback);
+    }
+  }
+  
+  tally.finish();
+}
 
 #endif
 
@@ -0,0 +1,1653 @@
+/***************************************************************************//**
+ * File:
+ * policy.h
+ *
+ * Author:
+ * Daniel Andrus
+ *
+ * Description:
+ * Contains the page replacement policies simulated by the msim command.
+ *
+ * Every policy plugs into the msim_run driver, which owns the frames and the
+ * lookup of resident pages. A policy only tracks its own bookkeeping for each
+ * frame ("slot") and answers three calls:
+ *
+ * on_hit(slot, i)     - the page in slot was referenced at position i
+ * on_miss(slot, i)    - the page referenced at position i was loaded into slot
+ * choose_victim(i)    - all frames are full; pick the slot to replace for the
+ *                       reference at position i
+ *
+ * Policies are constructed from the trace, the number of frames and a
+ * policy_config holding any tuning knobs. The trace has been remapped, so any
+ * state a policy keeps per page fits a flat array of ref_string.distinct()
+ * entries indexed by page id. The members are defined here so the
+ * compiler can inline them into the driver, giving every policy its own
+ * specialized simulation loop.
+ ******************************************************************************/
+
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <climits>
+#include "trace.h"
+
+using namespace std;
+
+/*******************************************************************************
+ * Tuning knobs for the policies, set from the msim command line.
+ *
+ * decay - LFU and MFU halve every count each time this many references have
+ * been made, so old popularity fades; 0 disables aging.
+ * window - OPT keeps the next use of every reference in a temporary file,
+ * mapping this many at a time, instead of in memory; 0 keeps them in memory.
+ ******************************************************************************/
+struct policy_config
+{
+  unsigned int decay;
+  size_t window;
+
+  policy_config() : decay(0), window(0) {}
+};
+
+/*******************************************************************************
+ * Node of an intrusive recency list. Every occupied frame owns exactly one
+ * node, which remembers the frame it belongs to so that an eviction never has
+ * to search the frame list.
+ ******************************************************************************/
+struct lru_node
+{
+  unsigned int slot;
+  lru_node* prev;
+  lru_node* next;
+};
+
+/*******************************************************************************
+ * Doubly linked list of lru_nodes ordered from least recently used (head) to
+ * most recently used (tail). Nodes are owned by the caller; the list only links
+ * them together, so every operation is constant time.
+ ******************************************************************************/
+struct lru_list
+{
+  lru_node* head;
+  lru_node* tail;
+
+  lru_list() : head(NULL), tail(NULL) {}
+
+  // Detaches a node that is currently linked into this list
+  void unlink(lru_node* node)
+  {
+    if (node->prev != NULL)
+      node->prev->next = node->next;
+    else
+      head = node->next;
+
+    if (node->next != NULL)
+      node->next->prev = node->prev;
+    else
+      tail = node->prev;
+
+    node->prev = NULL;
+    node->next = NULL;
+  }
+
+  // Appends a detached node at the most recently used end
+  void push_back(lru_node* node)
+  {
+    node->prev = tail;
+    node->next = NULL;
+
+    if (tail != NULL)
+      tail->next = node;
+    else
+      head = node;
+
+    tail = node;
+  }
+
+  // Moves every node of another list to the most recently used end
+  void splice(lru_list& other)
+  {
+    if (other.head == NULL)
+      return;
+
+    if (tail != NULL)
+      tail->next = other.head;
+    else
+      head = other.head;
+
+    other.head->prev = tail;
+    tail = other.tail;
+    other.head = NULL;
+    other.tail = NULL;
+  }
+};
+
+/*******************************************************************************
+ * "First in first out": the page that has been resident the longest is
+ * replaced, no matter how often it is referenced. Frames are filled in order
+ * and each replacement reuses the frame after the one replaced before, so the
+ * frames form a circular buffer and the oldest page is always under the hand.
+ ******************************************************************************/
+struct fifo_policy
+{
+  unsigned int num_frames;
+  unsigned int hand;            // frame holding the oldest page
+
+  fifo_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : num_frames(num_frames), hand(0) {}
+
+  void on_hit(unsigned int slot, size_t i) {}
+
+  void on_miss(unsigned int slot, size_t i) {}
+
+  unsigned int choose_victim(size_t i)
+  {
+    unsigned int slot = hand;
+
+    hand = (hand + 1 == num_frames ? 0 : hand + 1);
+    return slot;
+  }
+};
+
+/*******************************************************************************
+ * Optimal (predictive): the page whose next reference lies furthest in the
+ * future is replaced, with pages never used again replaced from the lowest
+ * frame first.
+ *
+ * On construction a single backwards pass records for every position the
+ * index of the next reference to the same page. Resident frames are kept in a
+ * set ordered by their next use, so picking the victim is a logarithmic lookup
+ * instead of a forward scan. Given a window, the next uses go to a temporary
+ * file read back through a sliding mapping, for traces whose next uses do not
+ * fit in memory.
+ ******************************************************************************/
+struct opt_policy
+{
+  const trace& ref_string;
+  vector<unsigned int> next_use;    // next index referencing same page
+  trace_next_use spilled;           // the same, in a file, given a window
+  bool in_file;
+  vector<unsigned int> frame_next;  // next use of page held by a frame
+  set<pair<unsigned int, unsigned int> > by_next;   // (next use, frame)
+
+  opt_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : ref_string(ref_string), in_file(false)
+  {
+    if (config.window != 0)
+    {
+      in_file = trace_next_use_build(ref_string, config.window, spilled);
+      if (in_file)
+        return;
+      cout << "Failed to create a next-use file, keeping next uses in memory"
+           << endl;
+    }
+    keep_in_memory();
+  }
+
+  // Find next use of every reference, ref_string.size() meaning "never"
+  void keep_in_memory()
+  {
+    vector<unsigned int> later;
+    unordered_map<int, unsigned int> raw;   // for a trace not remapped
+    size_t i;
+
+    later.resize(ref_string.distinct(), ref_string.size());
+    next_use.resize(ref_string.size());
+    for (i = ref_string.size(); i-- > 0; )
+    {
+      unsigned int& latest = ref_string.distinct() != 0
+                             ? later[ref_string[i]]
+                             : raw.emplace(ref_string[i], ref_string.size())
+                                 .first->second;
+
+      next_use[i] = latest;
+      latest = i;
+    }
+  }
+
+  // A window of the file that cannot be mapped sends the rest of the run to
+  // next uses kept in memory, which hold the same values
+  unsigned int next(size_t i)
+  {
+    unsigned int value;
+
+    if (in_file && spilled.read(i, value))
+      return value;
+    if (in_file)
+    {
+      cout << "Failed to map the next-use file, keeping next uses in memory"
+           << endl;
+      in_file = false;
+      keep_in_memory();
+    }
+    return next_use[i];
+  }
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    // Page is needed again, move it to its new place in the ordering
+    by_next.erase(make_pair(frame_next[slot], slot));
+    frame_next[slot] = next(i);
+    by_next.insert(make_pair(frame_next[slot], slot));
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    if (slot == frame_next.size())
+      frame_next.push_back(0);
+    frame_next[slot] = next(i);
+    by_next.insert(make_pair(frame_next[slot], slot));
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    set<pair<unsigned int, unsigned int> >::iterator victim;
+    unsigned int slot;
+
+    // Pages never used again tie, in which case take the lowest frame
+    victim = by_next.lower_bound(make_pair(by_next.rbegin()->first, 0u));
+    slot = victim->second;
+    by_next.erase(victim);
+    return slot;
+  }
+};
+
+/*******************************************************************************
+ * "Least recently used": the page that has gone the longest without being
+ * referenced is replaced. Recency is kept in an intrusive list, so every
+ * operation is constant time.
+ ******************************************************************************/
+struct lru_policy
+{
+  vector<lru_node> nodes;       // one node per occupied frame
+  lru_list recency;             // LRU list that drives the algorithm
+
+  lru_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config)
+  {
+    // Node addresses must stay put, so never let the vector reallocate
+    nodes.reserve(min((size_t) num_frames, ref_string.size()));
+  }
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    // Move item to the back of the list
+    recency.unlink(&nodes[slot]);
+    recency.push_back(&nodes[slot]);
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    if (slot == nodes.size())
+    {
+      nodes.push_back(lru_node());
+      nodes.back().slot = slot;
+    }
+    recency.push_back(&nodes[slot]);
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    lru_node* node = recency.head;
+
+    recency.unlink(node);
+    return node->slot;
+  }
+};
+
+/*******************************************************************************
+ * All frames referenced the same number of times, in the order they reached
+ * that count. Buckets are linked in order of increasing count.
+ ******************************************************************************/
+struct freq_bucket
+{
+  unsigned int count;
+  lru_list members;
+  int prev;
+  int next;
+};
+
+/*******************************************************************************
+ * "Least frequently used" and "most frequently used": the page referenced the
+ * fewest (or most) times since it was loaded is replaced, ties going to the
+ * page that has held that count the longest. Most is true for MFU.
+ *
+ * Frames live in a list of count buckets, so a reference moves a frame to the
+ * neighbouring bucket and the victim is at the head of the first (or last)
+ * bucket, all in constant time. With decay set, every count is halved, rounding
+ * up, every decay references; equal counts then merge into one bucket.
+ ******************************************************************************/
+template <bool Most>
+struct frequency_policy
+{
+  vector<lru_node> nodes;         // one node per occupied frame
+  vector<int> bucket_of;          // frame -> bucket holding it
+  vector<freq_bucket> buckets;    // bucket storage, linked by index
+  vector<int> spare;              // unused bucket storage
+  int lowest;                     // bucket with the lowest count, or -1
+  int highest;                    // bucket with the highest count, or -1
+  unsigned int decay;
+  unsigned int until_decay;
+
+  frequency_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : lowest(-1), highest(-1),
+    decay(config.decay), until_decay(config.decay)
+  {
+    // Node addresses must stay put, so never let the vector reallocate
+    nodes.reserve(min((size_t) num_frames, ref_string.size()));
+  }
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    int from = bucket_of[slot];
+    int to = buckets[from].next;
+
+    // Move frame to the bucket one count up, creating it if needed
+    if (to < 0 || buckets[to].count != buckets[from].count + 1)
+      to = add_bucket(buckets[from].count + 1, from);
+    remove(slot);
+    buckets[to].members.push_back(&nodes[slot]);
+    bucket_of[slot] = to;
+
+    age();
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    int to = lowest;
+
+    if (slot == nodes.size())
+    {
+      nodes.push_back(lru_node());
+      nodes.back().slot = slot;
+      bucket_of.push_back(-1);
+    }
+
+    // New pages start with a count of one
+    if (to < 0 || buckets[to].count != 1)
+      to = add_bucket(1, -1);
+    buckets[to].members.push_back(&nodes[slot]);
+    bucket_of[slot] = to;
+
+    age();
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    unsigned int slot = buckets[Most ? highest : lowest].members.head->slot;
+
+    remove(slot);
+    return slot;
+  }
+
+  // Creates an empty bucket linked after another, or first if after is -1
+  int add_bucket(unsigned int count, int after)
+  {
+    int b;
+
+    if (spare.empty())
+    {
+      b = buckets.size();
+      buckets.push_back(freq_bucket());
+    }
+    else
+    {
+      b = spare.back();
+      spare.pop_back();
+    }
+
+    buckets[b].count = count;
+    buckets[b].prev = after;
+    buckets[b].next = (after < 0 ? lowest : buckets[after].next);
+    if (buckets[b].prev < 0)
+      lowest = b;
+    else
+      buckets[buckets[b].prev].next = b;
+    if (buckets[b].next < 0)
+      highest = b;
+    else
+      buckets[buckets[b].next].prev = b;
+
+    return b;
+  }
+
+  // Unlinks a bucket and keeps its storage for later
+  void drop_bucket(int b)
+  {
+    if (buckets[b].prev < 0)
+      lowest = buckets[b].next;
+    else
+      buckets[buckets[b].prev].next = buckets[b].next;
+    if (buckets[b].next < 0)
+      highest = buckets[b].prev;
+    else
+      buckets[buckets[b].next].prev = buckets[b].prev;
+
+    spare.push_back(b);
+  }
+
+  // Takes a frame out of its bucket, dropping the bucket if left empty
+  void remove(unsigned int slot)
+  {
+    int b = bucket_of[slot];
+
+    buckets[b].members.unlink(&nodes[slot]);
+    if (buckets[b].members.head == NULL)
+      drop_bucket(b);
+  }
+
+  // Halves every count once decay references have passed
+  void age()
+  {
+    int b;
+    int next;
+    int kept = -1;
+    lru_node* node;
+
+    if (decay == 0 || --until_decay > 0)
+      return;
+    until_decay = decay;
+
+    for (b = lowest; b >= 0; b = next)
+    {
+      next = buckets[b].next;
+      buckets[b].count -= buckets[b].count / 2;
+
+      // Halving keeps counts in order, so only neighbours can collide
+      if (kept >= 0 && buckets[kept].count == buckets[b].count)
+      {
+        for (node = buckets[b].members.head; node != NULL; node = node->next)
+          bucket_of[node->slot] = kept;
+        buckets[kept].members.splice(buckets[b].members);
+        drop_bucket(b);
+      }
+      else
+      {
+        kept = b;
+      }
+    }
+  }
+};
+
+typedef frequency_policy<false> lfu_policy;
+typedef frequency_policy<true> mfu_policy;
+
+/*******************************************************************************
+ * "Second chance": frames are kept in the order they were filled. On a fault
+ * the oldest frame whose page was not referenced since it was loaded or last
+ * passed over is replaced, and every referenced page passed over loses its
+ * reference bit. If every page was referenced, the oldest is replaced.
+ *
+ * Pages passed over keep their place at the front, so the victim may come from
+ * the middle of the queue; the queue is therefore an intrusive list rather than
+ * a circular buffer. Every page passed over costs one earlier hit, so choosing
+ * a victim is amortized constant time.
+ ******************************************************************************/
+struct sc_policy
+{
+  vector<lru_node> nodes;       // one node per occupied frame
+  lru_list queue;               // FIFO list that drives the algorithm
+  vector<char> refbit;
+
+  sc_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config)
+  {
+    // Node addresses must stay put, so never let the vector reallocate
+    nodes.reserve(min((size_t) num_frames, ref_string.size()));
+  }
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    refbit[slot] = 1;
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    if (slot == nodes.size())
+    {
+      nodes.push_back(lru_node());
+      nodes.back().slot = slot;
+      refbit.push_back(0);
+    }
+    refbit[slot] = 0;
+    queue.push_back(&nodes[slot]);
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    lru_node* node;
+
+    // Find first item in queue not referenced
+    for (node = queue.head; node != NULL && refbit[node->slot] == 1;
+         node = node->next)
+    {
+      refbit[node->slot] = 0;
+    }
+    if (node == NULL)
+    {
+      node = queue.head;
+    }
+
+    queue.unlink(node);
+    return node->slot;
+  }
+};
+
+/*******************************************************************************
+ * "Clock": a hand points at the most recently loaded or referenced frame. On a
+ * fault the hand sweeps forward, clearing reference bits, until it rests on an
+ * unreferenced frame, which is replaced.
+ ******************************************************************************/
+struct clock_policy
+{
+  vector<char> refbit;
+  unsigned int hand;
+
+  clock_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : hand(0) {}
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    hand = slot;
+    refbit[hand] = 1;
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    if (slot == refbit.size())
+      refbit.push_back(0);
+    hand = slot;
+    refbit[hand] = 0;
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    // Move hand until we find unreferenced item
+    while (refbit[hand] == 1)
+    {
+      refbit[hand] = 0;
+      hand++;
+      if (hand == refbit.size())
+      {
+        hand = 0;
+      }
+    }
+    return hand;
+  }
+};
+
+/*******************************************************************************
+ * "Enhanced second chance" (not recently used): frames are ranked by their
+ * reference and dirty bits, and a fault replaces a page from the best class
+ * found first by a hand sweeping forward from just past the last victim:
+ *
+ * (0, 0) - not referenced, clean: the best victim
+ * (0, 1) - not referenced but dirty: must be written back first
+ * (1, 0) - referenced recently but clean
+ * (1, 1) - referenced recently and dirty
+ *
+ * The first sweep looks for (0, 0) without changing anything, the second for
+ * (0, 1) while clearing the reference bits it passes, and if both fail the two
+ * are repeated, which must then succeed. Loading or referencing a page sets
+ * its reference bit, and writing it sets its dirty bit until it is evicted.
+ ******************************************************************************/
+struct esc_policy
+{
+  const trace& ref_string;
+  vector<char> refbit;
+  vector<char> dirty;
+  unsigned int hand;            // next frame to examine
+
+  esc_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : ref_string(ref_string), hand(0) {}
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    refbit[slot] = 1;
+    dirty[slot] |= ref_string.write(i);
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    if (slot == refbit.size())
+    {
+      refbit.push_back(0);
+      dirty.push_back(0);
+    }
+    refbit[slot] = 1;
+    dirty[slot] = ref_string.write(i);
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    unsigned int num_frames = refbit.size();
+    unsigned int pass;
+    unsigned int k;
+    unsigned int slot;
+
+    // Even passes look for (0, 0), odd passes for (0, 1) clearing bits
+    for (pass = 0; ; pass++)
+    {
+      for (k = 0, slot = hand; k < num_frames; k++)
+      {
+        if (refbit[slot] == 0 && dirty[slot] == (char) (pass & 1))
+        {
+          hand = (slot + 1 == num_frames ? 0 : slot + 1);
+          return slot;
+        }
+        if (pass & 1)
+          refbit[slot] = 0;
+        slot = (slot + 1 == num_frames ? 0 : slot + 1);
+      }
+    }
+  }
+};
+
+/*******************************************************************************
+ * Lists a page can be on under the adaptive policies: resident pages on T1
+ * (seen once recently) or T2 (seen at least twice), and pages recently evicted
+ * from those on the ghost lists B1 and B2, which remember only the page id.
+ ******************************************************************************/
+enum adaptive_list
+{
+  ADAPT_NONE,
+  ADAPT_T1,
+  ADAPT_T2,
+  ADAPT_B1,
+  ADAPT_B2,
+  ADAPT_LISTS
+};
+
+/*******************************************************************************
+ * The T1, T2, B1 and B2 lists of ARC and CAR, with one node per page id so
+ * that moving a page between lists, resident or ghost, is constant time. Each
+ * list runs from its least recently added page (head) to its most recently
+ * added one (tail), and the node of a resident page holds its frame.
+ ******************************************************************************/
+struct adaptive_lists
+{
+  vector<lru_node> nodes;       // node of each page id
+  vector<char> where;           // list each page is on
+  lru_list lists[ADAPT_LISTS];
+  unsigned int size[ADAPT_LISTS];
+
+  adaptive_lists(size_t num_pages) : nodes(num_pages), where(num_pages, 0)
+  {
+    fill(size, size + ADAPT_LISTS, 0);
+  }
+
+  // Moves a page to the tail of a list, or off every list for ADAPT_NONE
+  void move(int page, int to)
+  {
+    if (where[page] != ADAPT_NONE)
+    {
+      lists[(int) where[page]].unlink(&nodes[page]);
+      size[(int) where[page]]--;
+    }
+    if (to != ADAPT_NONE)
+    {
+      lists[to].push_back(&nodes[page]);
+      size[to]++;
+    }
+    where[page] = to;
+  }
+
+  // Page at the head of a non-empty list
+  int head(int list) const
+  {
+    return lists[list].head - nodes.data();
+  }
+};
+
+// Number of evenly spaced points at which an adaptive target is reported
+#define POLICY_TARGET_SAMPLES 10
+
+/*******************************************************************************
+ * Follows the adaptive target of ARC, CAR or CLOCK-Pro through a run: its
+ * range and mean over every reference, and its value at evenly spaced points
+ * of the trace so the way it moves between phases of the workload can be
+ * seen.
+ ******************************************************************************/
+struct target_history
+{
+  size_t interval;              // references between samples
+  size_t next;                  // position of the next sample
+  vector<unsigned int> samples;
+  unsigned int low;
+  unsigned int high;
+  unsigned int last;
+  double total;
+  size_t count;
+
+  target_history(size_t references)
+    : interval(max(references / POLICY_TARGET_SAMPLES, (size_t) 1)), next(0),
+      low(UINT_MAX), high(0), last(0), total(0.0), count(0) {}
+
+  void record(size_t i, unsigned int target)
+  {
+    low = min(low, target);
+    high = max(high, target);
+    last = target;
+    total += target;
+    count++;
+    if (i >= next)
+    {
+      samples.push_back(target);
+      next += interval;
+    }
+  }
+
+  void report(const char* name, unsigned int num_frames) const
+  {
+    size_t j;
+
+    if (count == 0)
+      return;
+
+    cout << "adaptive target " << name << " (of " << num_frames
+         << " frames): min " << low
+         << ", mean " << fixed << setprecision(2) << total / count
+         << ", max " << high << ", final " << last << "\n";
+    cout.unsetf(ios::floatfield);
+    cout << name << " every " << interval << " references:";
+    for (j = 0; j < samples.size(); j++)
+      cout << " " << samples[j];
+    cout << endl;
+  }
+};
+
+/*******************************************************************************
+ * "Adaptive replacement cache" (ARC): resident pages are split between T1,
+ * pages referenced once since they were loaded, and T2, pages referenced
+ * again, each kept in LRU order. The ghost lists B1 and B2 remember pages
+ * recently evicted from T1 and T2, up to num_frames pages in all.
+ *
+ * The target p is the size T1 should have. A fault on a page remembered in B1
+ * means T1 was too small, so p grows; one on a page in B2 means T2 was too
+ * small, so p shrinks, each by the ratio of the ghost list sizes. The victim
+ * is the LRU page of T1 while T1 is larger than p, and of T2 otherwise. A
+ * single scan fills T1 and B1 only, so it cannot flush the pages in T2.
+ *
+ * Every reference moves a constant number of nodes between lists, and faults
+ * on pages remembered by a ghost list can only happen once all frames are in
+ * use, so the adaptation is done with the choice of victim.
+ ******************************************************************************/
+struct arc_policy
+{
+  const trace& ref_string;
+  adaptive_lists lists;
+  unsigned int num_frames;
+  unsigned int target;          // p, the adaptive target size of T1
+  target_history history;
+
+  arc_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : ref_string(ref_string),
+    lists(ref_string.distinct()), num_frames(num_frames), target(0),
+    history(ref_string.size()) {}
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    lists.move(ref_string[i], ADAPT_T2);
+    history.record(i, target);
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    int page = ref_string[i];
+
+    // Pages remembered by a ghost list have been seen twice
+    lists.nodes[page].slot = slot;
+    if (lists.where[page] == ADAPT_B1 || lists.where[page] == ADAPT_B2)
+      lists.move(page, ADAPT_T2);
+    else
+      lists.move(page, ADAPT_T1);
+    history.record(i, target);
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    int page = ref_string[i];
+    unsigned int* size = lists.size;
+    int victim;
+
+    if (lists.where[page] == ADAPT_B1)
+    {
+      target = min(num_frames,
+                   target + max(size[ADAPT_B2] / size[ADAPT_B1], 1u));
+    }
+    else if (lists.where[page] == ADAPT_B2)
+    {
+      target -= min(target, max(size[ADAPT_B1] / size[ADAPT_B2], 1u));
+    }
+    else if (size[ADAPT_T1] + size[ADAPT_B1] == num_frames)
+    {
+      // T1 fills the cache on its own: drop its LRU page without a ghost
+      if (size[ADAPT_B1] == 0)
+      {
+        victim = lists.head(ADAPT_T1);
+        lists.move(victim, ADAPT_NONE);
+        return lists.nodes[victim].slot;
+      }
+      lists.move(lists.head(ADAPT_B1), ADAPT_NONE);
+    }
+    else if (size[ADAPT_T1] + size[ADAPT_T2] + size[ADAPT_B1]
+             + size[ADAPT_B2] == 2 * num_frames)
+    {
+      lists.move(lists.head(ADAPT_B2), ADAPT_NONE);
+    }
+
+    // Evict from T1 if it is over target, remembering the page in a ghost list
+    if (size[ADAPT_T1] > 0
+        && (size[ADAPT_T1] > target || (size[ADAPT_T1] == target
+                                        && lists.where[page] == ADAPT_B2)))
+    {
+      victim = lists.head(ADAPT_T1);
+      lists.move(victim, ADAPT_B1);
+    }
+    else
+    {
+      victim = lists.head(ADAPT_T2);
+      lists.move(victim, ADAPT_B2);
+    }
+    return lists.nodes[victim].slot;
+  }
+};
+
+/*******************************************************************************
+ * "Clock with adaptive replacement" (CAR): ARC with T1 and T2 kept as clocks
+ * instead of LRU lists, so a hit only sets the page's reference bit. B1, B2
+ * and the adaptive target p work as in ARC.
+ *
+ * To find a victim the hand of T1 is used while T1 holds at least p pages, and
+ * the hand of T2 otherwise. An unreferenced page under the hand is evicted to
+ * the matching ghost list. A referenced one has its bit cleared and goes to
+ * the tail of T2, where it waits one trip around the clock. Every page passed
+ * over was referenced since it was last passed over, so choosing a victim is
+ * amortized constant time.
+ ******************************************************************************/
+struct car_policy
+{
+  const trace& ref_string;
+  adaptive_lists lists;
+  vector<char> refbit;          // reference bit of each page id
+  unsigned int num_frames;
+  unsigned int target;          // p, the adaptive target size of T1
+  target_history history;
+
+  car_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : ref_string(ref_string),
+    lists(ref_string.distinct()), refbit(ref_string.distinct(), 0),
+    num_frames(num_frames), target(0), history(ref_string.size()) {}
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    refbit[ref_string[i]] = 1;
+    history.record(i, target);
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    int page = ref_string[i];
+    unsigned int* size = lists.size;
+
+    // Pages remembered by a ghost list adapt the target and go to T2
+    lists.nodes[page].slot = slot;
+    refbit[page] = 0;
+    if (lists.where[page] == ADAPT_B1)
+    {
+      target = min(num_frames,
+                   target + max(size[ADAPT_B2] / size[ADAPT_B1], 1u));
+      lists.move(page, ADAPT_T2);
+    }
+    else if (lists.where[page] == ADAPT_B2)
+    {
+      target -= min(target, max(size[ADAPT_B1] / size[ADAPT_B2], 1u));
+      lists.move(page, ADAPT_T2);
+    }
+    else
+    {
+      lists.move(page, ADAPT_T1);
+    }
+    history.record(i, target);
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    int page = ref_string[i];
+    unsigned int* size = lists.size;
+    unsigned int slot;
+    int victim;
+
+    // Sweep the clocks until an unreferenced page turns up
+    for (;;)
+    {
+      if (size[ADAPT_T1] >= max(1u, target))
+      {
+        victim = lists.head(ADAPT_T1);
+        if (!refbit[victim])
+        {
+          lists.move(victim, ADAPT_B1);
+          break;
+        }
+        refbit[victim] = 0;
+        lists.move(victim, ADAPT_T2);
+      }
+      else
+      {
+        victim = lists.head(ADAPT_T2);
+        if (!refbit[victim])
+        {
+          lists.move(victim, ADAPT_B2);
+          break;
+        }
+        refbit[victim] = 0;
+        lists.move(victim, ADAPT_T2);
+      }
+    }
+    slot = lists.nodes[victim].slot;
+
+    // Keep the ghost lists within bounds for pages seen for the first time
+    if (lists.where[page] != ADAPT_B1 && lists.where[page] != ADAPT_B2)
+    {
+      if (size[ADAPT_T1] + size[ADAPT_B1] == num_frames)
+        lists.move(lists.head(ADAPT_B1), ADAPT_NONE);
+      else if (size[ADAPT_T1] + size[ADAPT_T2] + size[ADAPT_B1]
+               + size[ADAPT_B2] == 2 * num_frames)
+        lists.move(lists.head(ADAPT_B2), ADAPT_NONE);
+    }
+    return slot;
+  }
+};
+
+// Share of the frames given to pages of weak locality, in percent, by LIRS
+// and, as its starting cold target, by CLOCK-Pro
+#define POLICY_COLD_PERCENT 1
+
+// Non-resident pages LIRS keeps in its stack, in multiples of the frames
+#define POLICY_LIRS_GHOSTS 2
+
+// Status of a page under LIRS
+enum lirs_status
+{
+  LIRS_NONE,                    // unknown, or forgotten
+  LIRS_LIR,                     // resident, low inter-reference recency
+  LIRS_HIR,                     // resident, high inter-reference recency
+  LIRS_GHOST                    // evicted HIR page still on the stack
+};
+
+/*******************************************************************************
+ * "Low inter-reference recency set" (LIRS): pages are ranked by the recency of
+ * their last two references rather than just the last one. Most frames hold
+ * LIR pages, whose two last references were close together; a small share
+ * holds HIR pages, and the victim is always the oldest resident HIR page.
+ *
+ * The stack S orders pages by recency, from its bottom (head) to its top
+ * (tail), and holds every LIR page plus HIR pages, resident or not, referenced
+ * more recently than the oldest LIR page. An HIR page referenced while still
+ * on S has a reuse distance shorter than that LIR page, so it becomes LIR and
+ * the bottom LIR page becomes HIR. The queue Q lists resident HIR pages in the
+ * order they will be evicted.
+ *
+ * After every change the stack is pruned: HIR pages at its bottom are dropped,
+ * so the bottom is always a LIR page. Each page is pruned at most once per
+ * time it is pushed, making pruning amortized constant time. Evicted pages
+ * still on the stack are kept in a ghost queue as well, and once there are
+ * more than POLICY_LIRS_GHOSTS times the frames the oldest is forgotten, which
+ * bounds the stack.
+ ******************************************************************************/
+struct lirs_policy
+{
+  const trace& ref_string;
+  vector<lru_node> stack_nodes;     // node of each page on S
+  vector<lru_node> queue_nodes;     // node of each page on Q or the ghosts
+  vector<char> status;
+  vector<char> stacked;             // whether each page is on S
+  lru_list stack;                   // S, bottom to top
+  lru_list queue;                   // Q, next victim first
+  lru_list ghosts;                  // evicted pages on S, oldest first
+  unsigned int lir_max;
+  unsigned int lir_count;
+  unsigned int ghost_max;
+  unsigned int ghost_count;
+
+  lirs_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : ref_string(ref_string),
+    stack_nodes(ref_string.distinct()), queue_nodes(ref_string.distinct()),
+    status(ref_string.distinct(), LIRS_NONE),
+    stacked(ref_string.distinct(), 0), lir_count(0),
+    ghost_max(POLICY_LIRS_GHOSTS * num_frames), ghost_count(0)
+  {
+    lir_max = num_frames - max(1u, num_frames * POLICY_COLD_PERCENT / 100);
+  }
+
+  // Puts a page on top of S
+  void push(int page)
+  {
+    if (stacked[page])
+      stack.unlink(&stack_nodes[page]);
+    stack.push_back(&stack_nodes[page]);
+    stacked[page] = 1;
+  }
+
+  // Drops HIR pages from the bottom of S
+  void prune()
+  {
+    int page;
+
+    while (stack.head != NULL
+           && status[page = stack.head - stack_nodes.data()] != LIRS_LIR)
+    {
+      stack.unlink(&stack_nodes[page]);
+      stacked[page] = 0;
+      if (status[page] == LIRS_GHOST)
+      {
+        ghosts.unlink(&queue_nodes[page]);
+        ghost_count--;
+        status[page] = LIRS_NONE;
+      }
+    }
+  }
+
+  // Makes a page on top of S a LIR page, demoting the bottom one if need be
+  void promote(int page)
+  {
+    int bottom;
+
+    if (lir_count == lir_max)
+    {
+      bottom = stack.head - stack_nodes.data();
+      stack.unlink(&stack_nodes[bottom]);
+      stacked[bottom] = 0;
+      status[bottom] = LIRS_HIR;
+      queue.push_back(&queue_nodes[bottom]);
+      lir_count--;
+    }
+    status[page] = LIRS_LIR;
+    lir_count++;
+    prune();
+  }
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    int page = ref_string[i];
+
+    if (status[page] == LIRS_LIR)
+    {
+      push(page);
+      prune();
+    }
+    else if (stacked[page] && lir_max > 0)
+    {
+      queue.unlink(&queue_nodes[page]);
+      push(page);
+      promote(page);
+    }
+    else
+    {
+      push(page);
+      queue.unlink(&queue_nodes[page]);
+      queue.push_back(&queue_nodes[page]);
+    }
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    int page = ref_string[i];
+
+    queue_nodes[page].slot = slot;
+    if (status[page] == LIRS_GHOST)
+    {
+      ghosts.unlink(&queue_nodes[page]);
+      ghost_count--;
+    }
+
+    // Pages on S and every page until the LIR set is full become LIR
+    if (lir_count < lir_max || (status[page] == LIRS_GHOST && lir_max > 0))
+    {
+      push(page);
+      promote(page);
+    }
+    else
+    {
+      status[page] = LIRS_HIR;
+      push(page);
+      queue.push_back(&queue_nodes[page]);
+    }
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    int page = queue.head - queue_nodes.data();
+    int ghost;
+
+    queue.unlink(&queue_nodes[page]);
+    if (!stacked[page])
+    {
+      status[page] = LIRS_NONE;
+      return queue_nodes[page].slot;
+    }
+
+    // Still on S, so remember it as a ghost
+    status[page] = LIRS_GHOST;
+    ghosts.push_back(&queue_nodes[page]);
+    ghost_count++;
+    if (ghost_count > ghost_max)
+    {
+      ghost = ghosts.head - queue_nodes.data();
+      ghosts.unlink(&queue_nodes[ghost]);
+      stack.unlink(&stack_nodes[ghost]);
+      stacked[ghost] = 0;
+      status[ghost] = LIRS_NONE;
+      ghost_count--;
+    }
+    return queue_nodes[page].slot;
+  }
+};
+
+/*******************************************************************************
+ * "CLOCK-Pro": LIRS approximated on a single clock. Resident pages are hot or
+ * cold, and a cold page that is referenced again while in its test period
+ * becomes hot. The clock also keeps up to num_frames non-resident cold pages
+ * whose test period is still running, so a fault on one of those marks a
+ * short reuse distance too. Three hands sweep the clock, each moving pages to
+ * the head of the clock, just behind the hot hand:
+ *
+ * hand_cold - finds a victim among the cold resident pages. A referenced cold
+ * page becomes hot if it is in its test period, or starts one otherwise. An
+ * unreferenced one is evicted, staying on the clock if in its test period.
+ * hand_hot - turns unreferenced hot pages cold whenever there are more hot
+ * pages than num_frames less the cold target, ending the test period of every
+ * cold page it passes.
+ * hand_test - ends test periods, forgetting non-resident pages, whenever the
+ * clock holds more than num_frames of them.
+ *
+ * The cold target adapts: it grows when a non-resident page in its test
+ * period is referenced and shrinks when a test period ends without one. A
+ * hit only sets a reference bit, and every page a hand passes over had its
+ * bit set or its status changed since the last pass, so every reference is
+ * amortized constant time.
+ ******************************************************************************/
+struct clockpro_policy
+{
+  const trace& ref_string;
+  vector<lru_node> nodes;           // node of each page on the clock
+  vector<char> hot;
+  vector<char> test;                // cold page in its test period
+  vector<char> refbit;
+  vector<char> resident;
+  vector<char> clocked;             // whether each page is on the clock
+  lru_node* hand_hot;
+  lru_node* hand_cold;
+  lru_node* hand_test;
+  unsigned int num_frames;
+  unsigned int loaded;              // frames filled so far
+  unsigned int hot_count;
+  unsigned int ghost_count;         // non-resident pages on the clock
+  unsigned int cold_target;
+  unsigned int cold_max;
+  target_history history;
+
+  clockpro_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : ref_string(ref_string),
+    nodes(ref_string.distinct()), hot(ref_string.distinct(), 0),
+    test(ref_string.distinct(), 0), refbit(ref_string.distinct(), 0),
+    resident(ref_string.distinct(), 0), clocked(ref_string.distinct(), 0),
+    hand_hot(NULL), hand_cold(NULL), hand_test(NULL), num_frames(num_frames),
+    loaded(0), hot_count(0), ghost_count(0),
+    cold_target(max(1u, num_frames * POLICY_COLD_PERCENT / 100)),
+    cold_max(max(1u, num_frames - 1)), history(ref_string.size()) {}
+
+  int page_of(lru_node* node) const { return node - nodes.data(); }
+
+  // Puts a page at the head of the clock
+  void insert(int page)
+  {
+    lru_node* node = &nodes[page];
+
+    if (hand_hot == NULL)
+    {
+      node->prev = node;
+      node->next = node;
+      hand_hot = node;
+      hand_cold = node;
+      hand_test = node;
+    }
+    else
+    {
+      node->next = hand_hot;
+      node->prev = hand_hot->prev;
+      hand_hot->prev->next = node;
+      hand_hot->prev = node;
+    }
+    clocked[page] = 1;
+  }
+
+  // Takes a page off the clock, moving any hand on it to the next page
+  void remove(int page)
+  {
+    lru_node* node = &nodes[page];
+    lru_node* next = (node->next == node ? NULL : node->next);
+
+    if (hand_hot == node)
+      hand_hot = next;
+    if (hand_cold == node)
+      hand_cold = next;
+    if (hand_test == node)
+      hand_test = next;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    clocked[page] = 0;
+  }
+
+  // Ends the test period of a cold page that was not referenced in time
+  void end_test(int page)
+  {
+    test[page] = 0;
+    if (!resident[page])
+    {
+      remove(page);
+      ghost_count--;
+    }
+    if (cold_target > 1)
+      cold_target--;
+  }
+
+  // Turns the next unreferenced hot page cold
+  void run_hand_hot()
+  {
+    int page;
+
+    for (;;)
+    {
+      page = page_of(hand_hot);
+      hand_hot = hand_hot->next;
+      if (hot[page])
+      {
+        if (!refbit[page])
+        {
+          hot[page] = 0;
+          hot_count--;
+          return;
+        }
+        refbit[page] = 0;
+      }
+      else if (test[page])
+      {
+        end_test(page);
+      }
+    }
+  }
+
+  // Forgets the next non-resident page
+  void run_hand_test()
+  {
+    int page;
+
+    for (;;)
+    {
+      page = page_of(hand_test);
+      hand_test = hand_test->next;
+      if (!hot[page] && test[page])
+      {
+        end_test(page);
+        if (!resident[page])
+          return;
+      }
+    }
+  }
+
+  // Keeps the number of hot pages within what the cold target leaves
+  void balance()
+  {
+    while (hot_count > num_frames - cold_target)
+      run_hand_hot();
+  }
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    refbit[ref_string[i]] = 1;
+    history.record(i, cold_target);
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    int page = ref_string[i];
+    bool filling = (slot == loaded);
+
+    if (filling)
+      loaded++;
+    nodes[page].slot = slot;
+    resident[page] = 1;
+    refbit[page] = 0;
+
+    if (clocked[page])
+    {
+      // Reused within its test period: make room for more cold pages
+      cold_target = min(cold_target + 1, cold_max);
+      remove(page);
+      ghost_count--;
+      test[page] = 0;
+      hot[page] = 1;
+      hot_count++;
+      insert(page);
+      balance();
+    }
+    else if (filling && hot_count < num_frames - cold_target)
+    {
+      hot[page] = 1;
+      hot_count++;
+      insert(page);
+    }
+    else
+    {
+      test[page] = 1;
+      insert(page);
+    }
+    history.record(i, cold_target);
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    unsigned int slot;
+    int page;
+
+    for (;;)
+    {
+      page = page_of(hand_cold);
+      if (!resident[page] || hot[page])
+      {
+        hand_cold = hand_cold->next;
+        continue;
+      }
+
+      if (refbit[page])
+      {
+        // Referenced: promote it if it is being tested, else start a test
+        refbit[page] = 0;
+        remove(page);
+        if (test[page])
+        {
+          test[page] = 0;
+          hot[page] = 1;
+          hot_count++;
+          insert(page);
+          balance();
+        }
+        else
+        {
+          test[page] = 1;
+          insert(page);
+        }
+        continue;
+      }
+
+      // Unreferenced: evict it, keeping it on the clock while being tested
+      slot = nodes[page].slot;
+      resident[page] = 0;
+      hand_cold = hand_cold->next;
+      if (test[page])
+      {
+        ghost_count++;
+        while (ghost_count > num_frames)
+          run_hand_test();
+      }
+      else
+      {
+        remove(page);
+      }
+      return slot;
+    }
+  }
+};
+
+// Share of the frames W-TinyLFU gives its admission window, in percent
+#define POLICY_WINDOW_PERCENT 1
+
+// Share of the main region W-TinyLFU keeps protected, in percent
+#define POLICY_PROTECTED_PERCENT 80
+
+// References per frame after which the frequency sketch is halved
+#define POLICY_SKETCH_SAMPLES 10
+
+// 64-bit words in each block of the sketch, one cache line
+#define POLICY_SKETCH_BLOCK 8
+
+/*******************************************************************************
+ * Count-min sketch of 4-bit counters estimating how often each page has been
+ * referenced recently. Sixteen counters are packed into each 64-bit word, and
+ * the four counters of a page all lie in one cache-line sized block picked by
+ * its hash, one per pair of words, so an update or estimate touches a single
+ * line. Once there have been POLICY_SKETCH_SAMPLES references per frame every
+ * counter is halved, which ages out old popularity.
+ ******************************************************************************/
+struct frequency_sketch
+{
+  vector<uint64_t> storage;
+  uint64_t* table;                  // storage aligned to a cache line
+  uint64_t words;
+  uint64_t block_mask;
+  unsigned int additions;
+  unsigned int sample_size;
+
+  frequency_sketch(unsigned int num_frames) : words(POLICY_SKETCH_BLOCK),
+    additions(0), sample_size(POLICY_SKETCH_SAMPLES * max(num_frames, 1u))
+  {
+    // About one word, or sixteen counters, per frame
+    while (words < num_frames)
+      words <<= 1;
+    block_mask = words / POLICY_SKETCH_BLOCK - 1;
+    storage.resize(words + POLICY_SKETCH_BLOCK);
+    table = storage.data();
+    while ((uintptr_t) table % (POLICY_SKETCH_BLOCK * sizeof(uint64_t)) != 0)
+      table++;
+  }
+
+  // Mixes the bits of a page id or number (splitmix64 finalizer)
+  static uint64_t hash(long long page)
+  {
+    uint64_t x = (uint64_t) page + 0x9e3779b97f4a7c15ull;
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  // Word and bit offset of the counter of a page in one row of the sketch
+  uint64_t* counter(uint64_t h, int row, unsigned int& shift) const
+  {
+    uint64_t* block = table + (h & block_mask) * POLICY_SKETCH_BLOCK;
+
+    shift = ((h >> (32 + row * 4)) & 15) * 4;
+    return block + row * 2 + ((h >> (48 + row)) & 1);
+  }
+
+  void increment(int page)
+  {
+    uint64_t h = hash(page);
+    uint64_t* word;
+    unsigned int shift;
+    int row;
+
+    for (row = 0; row < 4; row++)
+    {
+      word = counter(h, row, shift);
+      if (((*word >> shift) & 15) != 15)
+        *word += 1ull << shift;
+    }
+
+    if (++additions == sample_size)
+      halve();
+  }
+
+  unsigned int estimate(int page) const
+  {
+    uint64_t h = hash(page);
+    uint64_t* word;
+    unsigned int shift;
+    unsigned int count = 15;
+    int row;
+
+    for (row = 0; row < 4; row++)
+    {
+      word = counter(h, row, shift);
+      count = min(count, (unsigned int) (*word >> shift) & 15);
+    }
+    return count;
+  }
+
+  // Halves every counter at once, sixteen to a word
+  void halve()
+  {
+    uint64_t i;
+
+    for (i = 0; i < words; i++)
+      table[i] = (table[i] >> 1) & 0x7777777777777777ull;
+    additions /= 2;
+  }
+};
+
+// Region of a page under W-TinyLFU
+enum tinylfu_region
+{
+  TINYLFU_NONE,
+  TINYLFU_WINDOW,
+  TINYLFU_PROBATION,
+  TINYLFU_PROTECTED
+};
+
+/*******************************************************************************
+ * "Window TinyLFU" (W-TinyLFU): new pages enter a small LRU window. When the
+ * window overflows, its least recently used page becomes a candidate for the
+ * main region, a segmented LRU, and is admitted only if the frequency sketch
+ * says it is referenced more often than the page the main region would evict;
+ * whichever loses is evicted. Pages in the main region start on probation and
+ * move to the protected segment when referenced again, with the least
+ * recently used protected page going back to probation when it overflows.
+ *
+ * Unlike lfu, the sketch keeps counting pages after they are evicted, so a
+ * page's popularity is known when it comes back, at half a byte per counter.
+ ******************************************************************************/
+struct tinylfu_policy
+{
+  const trace& ref_string;
+  vector<lru_node> nodes;           // node of each page
+  vector<char> region;
+  lru_list window;
+  lru_list probation;
+  lru_list protect;
+  unsigned int window_max;
+  unsigned int window_count;
+  unsigned int protect_max;
+  unsigned int protect_count;
+  frequency_sketch sketch;
+
+  tinylfu_policy(trace& ref_string, unsigned int num_frames,
+    const policy_config& config) : ref_string(ref_string),
+    nodes(ref_string.distinct()), region(ref_string.distinct(), TINYLFU_NONE),
+    window_count(0), protect_count(0), sketch(num_frames)
+  {
+    window_max = max(1u, num_frames * POLICY_WINDOW_PERCENT / 100);
+    protect_max = (num_frames - window_max) * POLICY_PROTECTED_PERCENT / 100;
+  }
+
+  int page_of(lru_node* node) const { return node - nodes.data(); }
+
+  // Moves a page to the most recently used end of a region
+  void move(int page, lru_list& from, lru_list& to, char where)
+  {
+    from.unlink(&nodes[page]);
+    to.push_back(&nodes[page]);
+    region[page] = where;
+  }
+
+  void on_hit(unsigned int slot, size_t i)
+  {
+    int page = ref_string[i];
+
+    sketch.increment(page);
+    switch (region[page])
+    {
+    case TINYLFU_WINDOW:
+      move(page, window, window, TINYLFU_WINDOW);
+      break;
+
+    case TINYLFU_PROBATION:
+      move(page, probation, protect, TINYLFU_PROTECTED);
+      if (++protect_count > protect_max)
+      {
+        move(page_of(protect.head), protect, probation, TINYLFU_PROBATION);
+        protect_count--;
+      }
+      break;
+
+    case TINYLFU_PROTECTED:
+      move(page, protect, protect, TINYLFU_PROTECTED);
+      break;
+    }
+  }
+
+  void on_miss(unsigned int slot, size_t i)
+  {
+    int page = ref_string[i];
+
+    sketch.increment(page);
+    nodes[page].slot = slot;
+    region[page] = TINYLFU_WINDOW;
+    window.push_back(&nodes[page]);
+
+    // While frames are still free, window overflow goes straight to main
+    if (++window_count > window_max)
+    {
+      move(page_of(window.head), window, probation, TINYLFU_PROBATION);
+      window_count--;
+    }
+  }
+
+  unsigned int choose_victim(size_t i)
+  {
+    int candidate = page_of(window.head);
+    int victim;
+
+    // The window's oldest page leaves it to make room for the new one
+    window.unlink(&nodes[candidate]);
+    window_count--;
+
+    if (probation.head != NULL)
+      victim = page_of(probation.head);
+    else if (protect.head != NULL)
+      victim = page_of(protect.head);
+    else
+      victim = candidate;
+
+    // Admit the candidate only if it is more popular than the main victim
+    if (victim != candidate
+        && sketch.estimate(candidate) > sketch.estimate(victim))
+    {
+      if (region[victim] == TINYLFU_PROTECTED)
+      {
+        protect.unlink(&nodes[victim]);
+        protect_count--;
+      }
+      else
+      {
+        probation.unlink(&nodes[victim]);
+      }
+      probation.push_back(&nodes[candidate]);
+      region[candidate] = TINYLFU_PROBATION;
+    }
+    else
+    {
+      victim = candidate;
+    }
+
+    region[victim] = TINYLFU_NONE;
+    return nodes[victim].slot;
+  }
+};
+
+#endif
@@ -0,0 +1,142 @@
+/***************************************************************************//**
+ * File:
+ * pool.cpp
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Contains implementation for the work-stealing thread pool.
+ ******************************************************************************/
+
+#include "pool.h"
+
+/***************************************************************************//**
+ * work_pool::work_pool
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Creates a pool with one queue per worker thread.
+ *
+ * Parameters:
+ * num_threads - Number of workers, or 0 for one per hardware thread.
+ ******************************************************************************/
+work_pool::work_pool(unsigned int num_threads) : pending(0), next(0)
+{
+  if (num_threads == 0)
+    num_threads = max(1u, thread::hardware_concurrency());
+  
+  queues = vector<pool_queue>(num_threads);
+}
+
+/***************************************************************************//**
+ * work_pool::submit
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Adds a task to the pool, handing tasks to the workers in turn.
+ *
+ * Parameters:
+ * task - The task to run.
+ ******************************************************************************/
+void work_pool::submit(function<void()> task)
+{
+  pool_queue& queue = queues[next++ % queues.size()];
+  lock_guard<mutex> guard(queue.lock);
+  
+  queue.tasks.push_back(task);
+  pending++;
+}
+
+/***************************************************************************//**
+ * work_pool::run
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Starts the workers and waits until every submitted task has run.
+ ******************************************************************************/
+void work_pool::run()
+{
+  vector<thread> workers;
+  unsigned int i;
+  
+  for (i = 0; i < queues.size(); i++)
+    workers.push_back(thread(&work_pool::work, this, i));
+  for (i = 0; i < workers.size(); i++)
+    workers[i].join();
+}
+
+/***************************************************************************//**
+ * work_pool::work
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Body of each worker: runs tasks until no queue has any left.
+ *
+ * Parameters:
+ * self - Index of the worker's own queue.
+ ******************************************************************************/
+void work_pool::work(unsigned int self)
+{
+  function<void()> task;
+  
+  while (pending > 0)
+  {
+    if (take(self, task))
+      task();
+  }
+}
+
+/***************************************************************************//**
+ * work_pool::take
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Takes the next task for a worker, newest first from its own queue, or else
+ * the oldest task of the first other worker that has one.
+ *
+ * Parameters:
+ * self - Index of the worker's own queue.
+ * task - Receives the task.
+ *
+ * Returns:
+ * True if a task was taken.
+ ******************************************************************************/
+bool work_pool::take(unsigned int self, function<void()>& task)
+{
+  unsigned int i;
+  
+  for (i = 0; i < queues.size(); i++)
+  {
+    pool_queue& queue = queues[(self + i) % queues.size()];
+    lock_guard<mutex> guard(queue.lock);
+    
+    if (!queue.tasks.empty())
+    {
+      if (i == 0)
+      {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+      }
+      else
+      {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      pending--;
+      return true;
+    }
+  }
+  
+  return false;
+}
@@ -0,0 +1,56 @@
+/***************************************************************************//**
+ * File:
+ * pool.h
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Contains the work-stealing thread pool used to spread independent
+ * simulations across every core.
+ ******************************************************************************/
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+
+/*******************************************************************************
+ * One worker's share of the tasks. The owner takes tasks from the back while
+ * idle workers steal from the front, so the two rarely contend for the same
+ * end of the queue.
+ ******************************************************************************/
+struct pool_queue
+{
+  mutex lock;
+  deque<function<void()> > tasks;
+};
+
+/*******************************************************************************
+ * A work-stealing thread pool. Tasks are submitted up front and dealt out
+ * round robin to the workers' queues; run() then starts the workers and
+ * returns once every task has finished. A worker whose queue runs dry steals
+ * from the others, so uneven tasks still keep every core busy.
+ ******************************************************************************/
+struct work_pool
+{
+  vector<pool_queue> queues;
+  atomic<size_t> pending;
+  size_t next;
+
+  work_pool(unsigned int num_threads = 0);
+  void submit(function<void()> task);
+  void run();
+  void work(unsigned int self);
+  bool take(unsigned int self, function<void()>& task);
+};
+
+#endif
@@ -23,6 +23,7 @@
  *
  * Usage:
  * psim <file> <sjf | p | rr <quantum>>
+ * psim convert <text file> <binary file>
  *
  * Parameters:
  * argc - Number of arguments supplied to function
@@ -35,18 +36,58 @@ int psim(int argc, char*argv[])
 {
   int alg;
   string file;
-  int quantum;
+  int quantum = 0;
   ifstream fin;
   proc process;
   vector<proc> processes;
+  trace records;
+  vector<int> values;
+  size_t i;
   
   if(argc < 3)
   {
     //disp help
-    cout << "Usage:\n\tpsim <file> <sjf | p | rr <quantum>>" << endl;
+    cout << "Usage:\n\tpsim <file> <sjf | p | rr <quantum>>\n"
+         << "\tpsim convert <text file> <binary file>" << endl;
     return -1;
   }
 
+  if( strcasecmp(argv[1], "convert" ) == 0 )
+  {
+    if(argc < 4)
+    {
+      //disp error, usage
+      cout << "Missing binary file\n"
+           << "Usage:\n\tpsim convert <text file> <binary file>" << endl;
+      return -1;
+    }
+
+    fin.open( argv[2] );
+
+    if( !fin )
+    {
+      cout << "Failed to open " << argv[2] << " for input" << endl;
+      return -2;
+    }
+
+    while(fin >> process.start >> process.length >> process.priority)
+    {
+      values.push_back(process.start);
+      values.push_back(process.length);
+      values.push_back(process.priority);
+    }
+
+    if( !trace_write( argv[3], TRACE_PROCS, values.data(), values.size() / 3,
+                      3 ) )
+    {
+      cout << "Failed to write " << argv[3] << endl;
+      return -2;
+    }
+
+    cout << "Converted " << values.size() / 3 << " processes" << endl;
+    return 0;
+  }
+
   if( strcasecmp(argv[2], "rr" ) == 0 )
   {
     //prompt for quantum <q>
@@ -79,20 +120,44 @@ int psim(int argc, char*argv[])
     return -2;
   }
 
-  fin.open( argv[1] );
-
-  if( !fin )
+  if( trace_is_binary( argv[1] ) )
   {
-    //error opening file
-    //disp usage
-    return -2;
+    //binary traces are mapped, no parsing needed
+    if( !trace_open( argv[1], records, TRACE_PROCS ) )
+    {
+      cout << "Failed to read " << argv[1] << endl;
+      return -2;
+    }
+
+    processes.reserve( records.size() / 3 );
+    for( i = 0; i + 2 < records.size(); i += 3 )
+    {
+      process.id = processes.size() + 1;
+      process.start = records[i];
+      process.length = records[i + 1];
+      process.priority = records[i + 2];
+      process.remaining = process.length;
+      processes.push_back(process);
+    }
   }
-  
-  while(fin >> process.start >> process.length >> process.priority)
+
+  else
   {
-    process.id = processes.size() + 1; 
-    process.remaining = process.length;
-    processes.push_back(process);  
+    fin.open( argv[1] );
+
+    if( !fin )
+    {
+      //error opening file
+      //disp usage
+      return -2;
+    }
+
+    while(fin >> process.start >> process.length >> process.priority)
+    {
+      process.id = processes.size() + 1; 
+      process.remaining = process.length;
+      processes.push_back(process);  
+    }
   }
 
   sort( processes.begin(), processes.end() ); 
@@ -134,7 +199,7 @@ int psim(int argc, char*argv[])
 void psim_rr( vector<proc> &processes, const int quantum )
 {
   vector<proc> queue;
-  proc current;
+  proc current = proc();
   current.id = 0;
   current.remaining = -1;
   int t = 0;
@@ -249,7 +314,7 @@ void psim_p( vector<proc> &processes )
 {
   // declare variables
   vector<proc> queue;
-  proc current;
+  proc current = proc();
   current.id = 0;
   current.remaining = -1;
   int t = 0;
@@ -352,7 +417,7 @@ void psim_sjf( vector<proc> &processes )
 {
   // declare variables
   vector<proc> queue;
-  proc current;
+  proc current = proc();
   current.id = 0;
   current.remaining = -1;
   int t = 0;
@@ -19,6 +19,7 @@
 #include <string>
 #include <algorithm>
 #include <cstring>
+#include "trace.h"
 
 using namespace std;
 
@@ -0,0 +1,1555 @@
+/***************************************************************************//**
+ * File:
+ * trace.cpp
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Contains implementation for loading reference traces used by the simulation
+ * commands.
+ ******************************************************************************/
+
+#include "trace.h"
+
+// Temporary files go here unless TMPDIR says otherwise
+static const char* TRACE_TMP_DIR = "/tmp";
+
+// Files smaller than this are not worth spreading across threads
+static const size_t TRACE_CHUNK_MIN = 1 << 20;
+
+// Traces with fewer references than this are remapped in a single chunk
+static const size_t TRACE_REMAP_MIN = 1 << 16;
+
+/***************************************************************************//**
+ * trace_is_space
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Tests for the whitespace characters accepted between trace entries.
+ ******************************************************************************/
+static inline bool trace_is_space(char c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v'
+         || c == '\f';
+}
+
+/***************************************************************************//**
+ * trace_parse_flag
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Consumes an optional r or w flag, in either case, following an entry.
+ *
+ * Parameters:
+ * begin - Character just past the entry's digits; moved past any flag.
+ * end - One past the last character of the block.
+ *
+ * Returns:
+ * 1 if the entry is marked as a write, 0 otherwise.
+ ******************************************************************************/
+static inline char trace_parse_flag(const char*& begin, const char* end)
+{
+  char flag;
+  
+  if (begin == end)
+    return 0;
+  
+  flag = *begin | 0x20;
+  if (flag != 'r' && flag != 'w')
+    return 0;
+  
+  begin++;
+  return flag == 'w';
+}
+
+/***************************************************************************//**
+ * trace_trim_writes
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Fits the write flags of a loaded trace to the values kept, dropping them
+ * altogether if none of the values is a write.
+ *
+ * Parameters:
+ * writes - The write flags, or NULL if none were read.
+ * count - Number of values kept.
+ ******************************************************************************/
+static void trace_trim_writes(vector<char>* writes, size_t count)
+{
+  if (writes == NULL)
+    return;
+  
+  writes->resize(count);
+  if (find(writes->begin(), writes->end(), 1) == writes->end())
+    writes->clear();
+}
+
+/***************************************************************************//**
+ * trace::~trace
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Releases the mapping of a binary trace, if any.
+ ******************************************************************************/
+trace::~trace()
+{
+  if (map != NULL)
+    munmap(map, map_size);
+}
+
+/***************************************************************************//**
+ * trace_header_valid
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Checks a binary trace header against the kind of trace expected and the
+ * size of the file. The number of fields has to suit the kind, and the file
+ * has to hold every record the header claims.
+ *
+ * Parameters:
+ * header - The header read from the file.
+ * kind - TRACE_PAGES or TRACE_PROCS, the kind of trace expected.
+ * info - Status of the file.
+ *
+ * Returns:
+ * True if the records can be read as described, false otherwise.
+ ******************************************************************************/
+static bool trace_header_valid(const trace_header& header, unsigned int kind,
+  const struct stat& info)
+{
+  if (header.version != TRACE_VERSION || header.kind != kind
+      || (uint64_t) info.st_size < sizeof(header))
+    return false;
+  if (kind == TRACE_PAGES ? header.fields != 1 && header.fields != 2
+                          : header.fields != 3)
+    return false;
+  
+  // Divide rather than multiply, so a huge count cannot wrap around
+  return header.count <= ((uint64_t) info.st_size - sizeof(header))
+                         / (header.fields * sizeof(int32_t));
+}
+
+/***************************************************************************//**
+ * trace_open
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Loads a trace in either format. Binary traces are recognized by their header
+ * and mapped directly, so no parsing takes place; the header must describe a
+ * trace of the expected kind. Anything else is parsed as a text list of
+ * integers. Page traces may carry read/write flags: as r or w suffixes in
+ * text, and as a second field holding 1 for writes in binary, in which case
+ * the pages are copied out of the mapping.
+ *
+ * Parameters:
+ * path - Path of the file to read.
+ * t - Receives the trace.
+ * kind - TRACE_PAGES or TRACE_PROCS, the kind of trace expected.
+ *
+ * Returns:
+ * False if the file could not be read or is a binary trace of the wrong kind
+ * or a damaged one, true otherwise.
+ ******************************************************************************/
+bool trace_open(const char* path, trace& t, unsigned int kind)
+{
+  int fd;
+  struct stat info;
+  trace_header header;
+  void* map;
+  size_t i;
+  
+  if (!trace_is_binary(path))
+  {
+    if (!trace_load(path, t.storage,
+                    kind == TRACE_PAGES ? &t.writes : NULL))
+      return false;
+    t.data = t.storage.data();
+    t.count = t.storage.size();
+    return true;
+  }
+  
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  
+  // Validate header against the size of the file
+  if (read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header)
+      || fstat(fd, &info) != 0 || !trace_header_valid(header, kind, info))
+  {
+    close(fd);
+    return false;
+  }
+  
+  map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  madvise(map, info.st_size, MADV_SEQUENTIAL);
+  
+  t.map = map;
+  t.map_size = info.st_size;
+  t.data = (const int*) ((const char*) map + sizeof(header));
+  t.count = header.count * header.fields;
+  
+  // Page traces with write flags interleave them with the pages
+  if (kind == TRACE_PAGES && header.fields == 2)
+  {
+    t.count = header.count;
+    t.storage.resize(t.count);
+    t.writes.resize(t.count);
+    for (i = 0; i < t.count; i++)
+    {
+      t.storage[i] = t.data[2 * i];
+      t.writes[i] = (t.data[2 * i + 1] != 0);
+    }
+    munmap(t.map, t.map_size);
+    t.map = NULL;
+    t.map_size = 0;
+    t.data = t.storage.data();
+    trace_trim_writes(&t.writes, t.count);
+  }
+  return true;
+}
+
+/***************************************************************************//**
+ * trace_is_binary
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Checks whether a file starts with the binary trace magic number. Only
+ * regular files are checked, as reading from a pipe would consume its data.
+ *
+ * Parameters:
+ * path - Path of the file to check.
+ *
+ * Returns:
+ * True if the file is a binary trace.
+ ******************************************************************************/
+bool trace_is_binary(const char* path)
+{
+  char magic[4];
+  struct stat info;
+  
+  // Peeking at a pipe would swallow the bytes read, and it cannot be mapped
+  if (stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+    return false;
+  
+  ifstream fin(path, ios::binary);
+  
+  return fin.read(magic, sizeof(magic))
+         && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+}
+
+/***************************************************************************//**
+ * trace_write
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Writes values to a binary trace, recording the number of records in the
+ * header.
+ *
+ * Parameters:
+ * path - Path of the file to create.
+ * kind - TRACE_PAGES or TRACE_PROCS.
+ * values - The values of every record, one record after another.
+ * count - Number of records.
+ * fields - Number of values in each record.
+ *
+ * Returns:
+ * False if the file could not be written, true otherwise.
+ ******************************************************************************/
+bool trace_write(const char* path, unsigned int kind, const int* values,
+  size_t count, unsigned int fields)
+{
+  trace_header header;
+  ofstream fout;
+  
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.kind = kind;
+  header.fields = fields;
+  header.count = count;
+  
+  fout.open(path, ios::binary | ios::trunc);
+  if (!fout)
+    return false;
+  fout.write((const char*) &header, sizeof(header));
+  fout.write((const char*) values, count * fields * sizeof(int));
+  
+  return (bool) fout;
+}
+
+/***************************************************************************//**
+ * trace_remap_values
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Numbers the distinct values of an array from 0 in increasing order and
+ * translates every value to its number.
+ *
+ * The distinct values are found by sorting and deduplicating one chunk of the
+ * array per hardware thread and merging the chunks pairwise in parallel. Every
+ * value is then translated in parallel, through a direct table when the values
+ * are packed closely enough and by binary search otherwise.
+ *
+ * Parameters:
+ * values - The values to number.
+ * count - Number of values.
+ * pages - Receives the distinct values in increasing order.
+ * ids - Receives the number of every value.
+ ******************************************************************************/
+template <class T>
+static void trace_remap_values(const T* values, size_t count,
+  vector<long long>& pages, vector<int>& ids)
+{
+  size_t num_chunks;
+  size_t width;
+  size_t i;
+  vector<size_t> bounds;
+  vector<vector<T> > sorted;
+  vector<int> table;            // value - low -> id, if values are packed
+  vector<thread> workers;
+  T low = 0;
+  
+  num_chunks = max(1u, thread::hardware_concurrency());
+  num_chunks = min(num_chunks, count / TRACE_REMAP_MIN + 1);
+  bounds.resize(num_chunks + 1);
+  for (i = 0; i < num_chunks; i++)
+    bounds[i] = count / num_chunks * i;
+  bounds[num_chunks] = count;
+  
+  // Sort and deduplicate every chunk
+  sorted.resize(num_chunks);
+  for (i = 0; i < num_chunks; i++)
+  {
+    workers.push_back(thread([&, i]()
+    {
+      sorted[i].assign(values + bounds[i], values + bounds[i + 1]);
+      sort(sorted[i].begin(), sorted[i].end());
+      sorted[i].erase(unique(sorted[i].begin(), sorted[i].end()),
+                      sorted[i].end());
+    }));
+  }
+  for (i = 0; i < workers.size(); i++)
+    workers[i].join();
+  workers.clear();
+  
+  // Merge neighbouring runs until only one is left
+  for (width = 1; width < num_chunks; width *= 2)
+  {
+    for (i = 0; i + width < num_chunks; i += 2 * width)
+    {
+      workers.push_back(thread([&, i, width]()
+      {
+        vector<T>& left = sorted[i];
+        vector<T>& right = sorted[i + width];
+        vector<T> merged(left.size() + right.size());
+        
+        merged.erase(set_union(left.begin(), left.end(), right.begin(),
+                               right.end(), merged.begin()), merged.end());
+        left.swap(merged);
+        vector<T>().swap(right);
+      }));
+    }
+    for (i = 0; i < workers.size(); i++)
+      workers[i].join();
+    workers.clear();
+  }
+  vector<T>& distinct = sorted[0];
+  
+  // Values spanning no more than a few times the trace length can be
+  // translated with a table instead of a search
+  if (!distinct.empty()
+      && (uint64_t) distinct.back() - (uint64_t) distinct.front()
+         < 4ull * count)
+  {
+    low = distinct.front();
+    table.resize((uint64_t) distinct.back() - (uint64_t) low + 1);
+    for (i = 0; i < distinct.size(); i++)
+      table[(uint64_t) distinct[i] - (uint64_t) low] = i;
+  }
+  
+  // Translate every value
+  ids.resize(count);
+  for (i = 0; i < num_chunks; i++)
+  {
+    workers.push_back(thread([&, i]()
+    {
+      size_t k;
+      
+      if (!table.empty())
+      {
+        for (k = bounds[i]; k < bounds[i + 1]; k++)
+          ids[k] = table[(uint64_t) values[k] - (uint64_t) low];
+      }
+      else
+      {
+        for (k = bounds[i]; k < bounds[i + 1]; k++)
+          ids[k] = lower_bound(distinct.begin(), distinct.end(), values[k])
+                   - distinct.begin();
+      }
+    }));
+  }
+  for (i = 0; i < workers.size(); i++)
+    workers[i].join();
+  
+  pages.assign(distinct.begin(), distinct.end());
+}
+
+/***************************************************************************//**
+ * trace_remap
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Replaces the page numbers of a page trace with dense ids, numbering the
+ * distinct pages from 0 in increasing order of page number, and keeps the page
+ * number of every id so results can still be shown in terms of real pages.
+ * Simulations can then keep per-page state in flat arrays indexed by id. A
+ * mapped binary trace is released once its references have been translated.
+ *
+ * Parameters:
+ * t - The page trace to remap.
+ ******************************************************************************/
+void trace_remap(trace& t)
+{
+  vector<int> ids;
+  
+  trace_remap_values(t.data, t.count, t.pages, ids);
+  
+  if (t.map != NULL)
+  {
+    munmap(t.map, t.map_size);
+    t.map = NULL;
+    t.map_size = 0;
+  }
+  t.storage.swap(ids);
+  t.data = t.storage.data();
+}
+
+/***************************************************************************//**
+ * trace_open_addresses
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Loads a text trace of virtual addresses and turns it into a remapped page
+ * trace. Every address is reduced to its page number by a shift, and the page
+ * numbers, which may need all 64 bits, are remapped to dense ids as for any
+ * other page trace.
+ *
+ * Parameters:
+ * path - Path of the file to read.
+ * t - Receives the remapped page trace.
+ * page_size - Size of a page in bytes; must be a power of two.
+ *
+ * Returns:
+ * False if the file could not be read, true otherwise.
+ ******************************************************************************/
+bool trace_open_addresses(const char* path, trace& t, uint64_t page_size)
+{
+  vector<uint64_t> addresses;
+  unsigned int shift = 0;
+  
+  if (!trace_load_addresses(path, addresses, t.writes))
+    return false;
+  
+  while (((uint64_t) 1 << shift) < page_size)
+    shift++;
+  trace_page_numbers(addresses.data(), addresses.size(), shift);
+  
+  trace_remap_values(addresses.data(), addresses.size(), t.pages, t.storage);
+  t.data = t.storage.data();
+  t.count = t.storage.size();
+  return true;
+}
+
+/***************************************************************************//**
+ * trace_page_numbers
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Turns addresses into page numbers in place, one chunk per hardware thread.
+ * The shifts are grouped in blocks of four so the compiler turns each block
+ * into vector shifts.
+ *
+ * Parameters:
+ * addresses - The addresses to convert.
+ * count - Number of addresses.
+ * shift - Base two logarithm of the page size.
+ ******************************************************************************/
+void trace_page_numbers(uint64_t* addresses, size_t count, unsigned int shift)
+{
+  size_t num_chunks;
+  size_t i;
+  vector<thread> workers;
+  
+  num_chunks = max(1u, thread::hardware_concurrency());
+  num_chunks = min(num_chunks, count / TRACE_REMAP_MIN + 1);
+  for (i = 0; i < num_chunks; i++)
+  {
+    workers.push_back(thread([=]()
+    {
+      uint64_t* first = addresses + count / num_chunks * i;
+      uint64_t* last = (i + 1 == num_chunks) ? addresses + count
+                       : addresses + count / num_chunks * (i + 1);
+      
+      // Four at a time, so the block can be done with vector shifts
+      for ( ; first + 4 <= last; first += 4)
+      {
+        first[0] >>= shift;
+        first[1] >>= shift;
+        first[2] >>= shift;
+        first[3] >>= shift;
+      }
+      for ( ; first < last; first++)
+        *first >>= shift;
+    }));
+  }
+  for (i = 0; i < num_chunks; i++)
+    workers[i].join();
+}
+
+/***************************************************************************//**
+ * trace_load_values
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Reads a whitespace separated list of values from a file. The file is
+ * memory mapped and split into one chunk per hardware thread, each chunk
+ * beginning on a whitespace boundary. The chunks are first counted in parallel
+ * so the output can be sized exactly once, and then parsed in parallel
+ * straight into their place in the output. Like reading with operator>>,
+ * loading stops at the first malformed entry.
+ *
+ * Files that cannot be mapped, such as pipes, are read into memory through a
+ * stream and parsed in one piece instead.
+ *
+ * Parameters:
+ * path - Path of the file to read.
+ * refs - Receives the values in the order they appear in the file.
+ * writes - If not NULL, entries may carry a read/write flag and this receives
+ * the flag of every value; it is left empty if no value is a write.
+ * parse - Parses the entries of one chunk of text into values.
+ *
+ * Returns:
+ * False if the file could not be opened, true otherwise.
+ ******************************************************************************/
+template <class T>
+static bool trace_load_values(const char* path, vector<T>& refs,
+  vector<char>* writes,
+  size_t (*parse)(const char*, const char*, T*, char*, bool&))
+{
+  int fd;
+  struct stat info;
+  const char* data;
+  size_t size;
+  size_t num_chunks;
+  size_t i;
+  vector<size_t> bounds;
+  vector<size_t> offsets;
+  vector<size_t> parsed;
+  vector<char> valid;
+  vector<thread> workers;
+  ifstream fin;
+  string text;
+  bool ok;
+  
+  refs.clear();
+  
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  
+  // Anything that is not a regular file is read the slow way
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+  {
+    close(fd);
+    fin.open(path, ios::binary);
+    if (!fin)
+      return false;
+    text.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+    refs.resize(trace_count(text.data(), text.data() + text.size()));
+    if (writes != NULL)
+      writes->resize(refs.size());
+    refs.resize(parse(text.data(), text.data() + text.size(), refs.data(),
+                      writes != NULL ? writes->data() : NULL, ok));
+    trace_trim_writes(writes, refs.size());
+    return true;
+  }
+  
+  size = (size_t) info.st_size;
+  data = (const char*) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == (const char*) MAP_FAILED)
+    return false;
+  madvise((void*) data, size, MADV_SEQUENTIAL);
+  
+  // Split file into chunks, pushing each boundary past any entry it splits
+  num_chunks = max(1u, thread::hardware_concurrency());
+  num_chunks = min(num_chunks, size / TRACE_CHUNK_MIN + 1);
+  bounds.resize(num_chunks + 1);
+  bounds[0] = 0;
+  bounds[num_chunks] = size;
+  for (i = 1; i < num_chunks; i++)
+  {
+    bounds[i] = max(bounds[i - 1], size / num_chunks * i);
+    while (bounds[i] < size && !trace_is_space(data[bounds[i]]))
+      bounds[i]++;
+  }
+  
+  // Count entries in each chunk to find where each chunk's output begins
+  offsets.resize(num_chunks + 1, 0);
+  for (i = 0; i < num_chunks; i++)
+  {
+    workers.push_back(thread([&, i]()
+    {
+      offsets[i + 1] = trace_count(data + bounds[i], data + bounds[i + 1]);
+    }));
+  }
+  for (i = 0; i < num_chunks; i++)
+    workers[i].join();
+  workers.clear();
+  
+  for (i = 0; i < num_chunks; i++)
+    offsets[i + 1] += offsets[i];
+  refs.resize(offsets[num_chunks]);
+  if (writes != NULL)
+    writes->resize(refs.size());
+  
+  // Parse every chunk into its place
+  parsed.resize(num_chunks, 0);
+  valid.resize(num_chunks, 1);
+  for (i = 0; i < num_chunks; i++)
+  {
+    workers.push_back(thread([&, i]()
+    {
+      bool ok = true;
+      parsed[i] = parse(data + bounds[i], data + bounds[i + 1],
+                        refs.data() + offsets[i],
+                        writes != NULL ? writes->data() + offsets[i] : NULL,
+                        ok);
+      valid[i] = ok;
+    }));
+  }
+  for (i = 0; i < num_chunks; i++)
+    workers[i].join();
+  
+  munmap((void*) data, size);
+  
+  // Drop everything from the first malformed entry onwards
+  for (i = 0; i < num_chunks; i++)
+  {
+    if (!valid[i])
+    {
+      refs.resize(offsets[i] + parsed[i]);
+      break;
+    }
+  }
+  trace_trim_writes(writes, refs.size());
+  
+  return true;
+}
+
+/***************************************************************************//**
+ * trace_load
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Reads a whitespace separated list of integers from a file. Page traces may
+ * mark each entry as a read or a write with an r or w suffix, as in "12w";
+ * entries without one are reads.
+ *
+ * Parameters:
+ * path - Path of the file to read.
+ * refs - Receives the integers in the order they appear in the file.
+ * writes - If not NULL, suffixes are accepted and this receives 1 for every
+ * write and 0 for every read, or is left empty if there are no writes.
+ *
+ * Returns:
+ * False if the file could not be opened, true otherwise.
+ ******************************************************************************/
+bool trace_load(const char* path, vector<int>& refs, vector<char>* writes)
+{
+  return trace_load_values(path, refs, writes, trace_parse);
+}
+
+/***************************************************************************//**
+ * trace_load_addresses
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Reads a whitespace separated list of 64-bit addresses, each in hexadecimal
+ * with a 0x prefix or in decimal and optionally followed by an r or w flag,
+ * from a file.
+ *
+ * Parameters:
+ * path - Path of the file to read.
+ * addresses - Receives the addresses in the order they appear in the file.
+ * writes - Receives 1 for every write and 0 for every read, or is left empty
+ * if there are no writes.
+ *
+ * Returns:
+ * False if the file could not be opened, true otherwise.
+ ******************************************************************************/
+bool trace_load_addresses(const char* path, vector<uint64_t>& addresses,
+  vector<char>& writes)
+{
+  return trace_load_values(path, addresses, &writes, trace_parse_address);
+}
+
+/***************************************************************************//**
+ * trace_open_processes
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Loads a text trace of references by several processes, each entry written
+ * as pid:page, and turns it into a remapped page trace whose page numbers are
+ * the packed keys made by trace_key. Ids follow the order of the keys, so the
+ * pages of each process get consecutive ids.
+ *
+ * Parameters:
+ * path - Path of the file to read.
+ * t - Receives the remapped trace.
+ *
+ * Returns:
+ * False if the file could not be opened, true otherwise.
+ ******************************************************************************/
+bool trace_open_processes(const char* path, trace& t)
+{
+  vector<uint64_t> keys;
+  
+  if (!trace_load_values(path, keys, &t.writes, trace_parse_process))
+    return false;
+  
+  trace_remap_values(keys.data(), keys.size(), t.pages, t.storage);
+  t.data = t.storage.data();
+  t.count = t.storage.size();
+  return true;
+}
+
+/***************************************************************************//**
+ * trace_count
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Counts the whitespace separated entries in a block of text.
+ *
+ * Parameters:
+ * begin - First character of the block.
+ * end - One past the last character of the block.
+ *
+ * Returns:
+ * Number of entries found.
+ ******************************************************************************/
+size_t trace_count(const char* begin, const char* end)
+{
+  size_t count = 0;
+  bool in_entry = false;
+  bool space;
+  
+  for ( ; begin < end; begin++)
+  {
+    space = trace_is_space(*begin);
+    count += !space && !in_entry;
+    in_entry = !space;
+  }
+  
+  return count;
+}
+
+/***************************************************************************//**
+ * trace_parse
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Parses the whitespace separated integers in a block of text. Digits are
+ * accumulated directly rather than going through the locale aware stream
+ * machinery. As with operator>>, parsing stops at the first entry that does
+ * not begin with an integer, keeping the leading digits of one that does.
+ *
+ * Parameters:
+ * begin - First character of the block.
+ * end - One past the last character of the block.
+ * refs - Receives the parsed integers; must have room for every entry.
+ * writes - If not NULL, an r or w suffix is accepted after each integer and
+ * this receives 1 for every entry marked w and 0 for every other one.
+ * ok - Set to false if a malformed entry was found.
+ *
+ * Returns:
+ * Number of integers parsed.
+ ******************************************************************************/
+size_t trace_parse(const char* begin, const char* end, int* refs,
+  char* writes, bool& ok)
+{
+  size_t count = 0;
+  unsigned int value;
+  unsigned int digit;
+  bool negative;
+  const char* start;
+  
+  ok = true;
+  while (begin < end)
+  {
+    // Skip separators
+    while (begin < end && trace_is_space(*begin))
+      begin++;
+    if (begin == end)
+      break;
+    
+    // Optional sign
+    negative = (*begin == '-');
+    if (*begin == '-' || *begin == '+')
+      begin++;
+    
+    // Digits
+    value = 0;
+    start = begin;
+    while (begin < end && (digit = (unsigned char) *begin - '0') <= 9)
+    {
+      value = value * 10 + digit;
+      begin++;
+    }
+    
+    // Entry must start with a digit
+    if (begin == start)
+    {
+      ok = false;
+      break;
+    }
+    
+    refs[count] = negative ? (int) (0u - value) : (int) value;
+    if (writes != NULL)
+      writes[count] = trace_parse_flag(begin, end);
+    count++;
+    
+    // As with operator>>, trailing junk ends the trace after this value
+    if (begin < end && !trace_is_space(*begin))
+    {
+      ok = false;
+      break;
+    }
+  }
+  
+  return count;
+}
+
+/***************************************************************************//**
+ * trace_parse_process
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Parses the whitespace separated pid:page entries of a multi-process trace,
+ * both parts decimal integers, into keys made by trace_key. As with
+ * trace_parse, parsing stops at the first malformed entry.
+ *
+ * Parameters:
+ * begin - First character of the block.
+ * end - One past the last character of the block.
+ * keys - Receives the parsed keys; must have room for every entry.
+ * writes - If not NULL, an r or w suffix is accepted after each entry and
+ * this receives 1 for every entry marked w and 0 for every other one.
+ * ok - Set to false if a malformed entry was found.
+ *
+ * Returns:
+ * Number of entries parsed.
+ ******************************************************************************/
+size_t trace_parse_process(const char* begin, const char* end,
+  uint64_t* keys, char* writes, bool& ok)
+{
+  size_t count = 0;
+  unsigned int parts[2];
+  unsigned int value;
+  unsigned int digit;
+  unsigned int field;
+  bool negative;
+  const char* start;
+  
+  ok = true;
+  while (begin < end)
+  {
+    // Skip separators
+    while (begin < end && trace_is_space(*begin))
+      begin++;
+    if (begin == end)
+      break;
+    
+    // Process id, a colon, then the page
+    for (field = 0; field < 2; field++)
+    {
+      negative = (*begin == '-');
+      if (*begin == '-' || *begin == '+')
+        begin++;
+      
+      value = 0;
+      start = begin;
+      while (begin < end && (digit = (unsigned char) *begin - '0') <= 9)
+      {
+        value = value * 10 + digit;
+        begin++;
+      }
+      if (begin == start || (field == 0 && (begin == end || *begin != ':')))
+      {
+        ok = false;
+        return count;
+      }
+      if (field == 0)
+        begin++;
+      parts[field] = negative ? 0u - value : value;
+    }
+    
+    keys[count] = trace_key(parts[0], parts[1]);
+    if (writes != NULL)
+      writes[count] = trace_parse_flag(begin, end);
+    count++;
+    
+    // Trailing junk ends the trace after this entry
+    if (begin < end && !trace_is_space(*begin))
+    {
+      ok = false;
+      break;
+    }
+  }
+  
+  return count;
+}
+
+/***************************************************************************//**
+ * trace_parse_address
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Parses the whitespace separated addresses in a block of text. Addresses
+ * starting with 0x or 0X are read as hexadecimal and all others as decimal,
+ * keeping the low 64 bits of any that are longer. As with trace_parse,
+ * parsing stops at the first malformed entry, keeping the leading digits of
+ * one that starts with a number.
+ *
+ * Parameters:
+ * begin - First character of the block.
+ * end - One past the last character of the block.
+ * addresses - Receives the parsed addresses; must have room for every entry.
+ * writes - If not NULL, an r or w suffix is accepted after each address and
+ * this receives 1 for every entry marked w and 0 for every other one.
+ * ok - Set to false if a malformed entry was found.
+ *
+ * Returns:
+ * Number of addresses parsed.
+ ******************************************************************************/
+size_t trace_parse_address(const char* begin, const char* end,
+  uint64_t* addresses, char* writes, bool& ok)
+{
+  size_t count = 0;
+  uint64_t value;
+  unsigned int digit;
+  const char* start;
+  
+  ok = true;
+  while (begin < end)
+  {
+    // Skip separators
+    while (begin < end && trace_is_space(*begin))
+      begin++;
+    if (begin == end)
+      break;
+    
+    value = 0;
+    if (end - begin > 2 && begin[0] == '0' && (begin[1] | 0x20) == 'x')
+    {
+      // Hexadecimal digits
+      begin += 2;
+      start = begin;
+      while (begin < end)
+      {
+        digit = (unsigned char) *begin - '0';
+        if (digit > 9)
+        {
+          digit = ((unsigned char) *begin | 0x20) - 'a';
+          if (digit > 5)
+            break;
+          digit += 10;
+        }
+        value = value << 4 | digit;
+        begin++;
+      }
+    }
+    else
+    {
+      // Decimal digits
+      start = begin;
+      while (begin < end && (digit = (unsigned char) *begin - '0') <= 9)
+      {
+        value = value * 10 + digit;
+        begin++;
+      }
+    }
+    
+    // Entry must start with a digit
+    if (begin == start)
+    {
+      ok = false;
+      break;
+    }
+    
+    addresses[count] = value;
+    if (writes != NULL)
+      writes[count] = trace_parse_flag(begin, end);
+    count++;
+    
+    // Trailing junk ends the trace after this value
+    if (begin < end && !trace_is_space(*begin))
+    {
+      ok = false;
+      break;
+    }
+  }
+  
+  return count;
+}
+
+/***************************************************************************//**
+ * trace_is_stream
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Checks whether a trace can only be read as it arrives: standard input,
+ * given as "-", or anything other than a regular file, such as a named pipe.
+ *
+ * Parameters:
+ * path - Path of the trace.
+ *
+ * Returns:
+ * True if the trace has to be streamed.
+ ******************************************************************************/
+bool trace_is_stream(const char* path)
+{
+  struct stat info;
+  
+  return strcmp(path, "-") == 0
+         || (stat(path, &info) == 0 && !S_ISREG(info.st_mode));
+}
+
+/***************************************************************************//**
+ * trace_stream::~trace_stream
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Closes the input of a stream, unless it is standard input.
+ ******************************************************************************/
+trace_stream::~trace_stream()
+{
+  if (owned)
+    close(fd);
+}
+
+/***************************************************************************//**
+ * trace_stream_open
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Opens a trace for reading as it arrives. "-" stands for standard input,
+ * which the shell also reads its commands from, so it is read through the C
+ * stream and ends at a TRACE_STREAM_END line; the commands after that line
+ * are left for the shell. A binary page trace file has its header checked
+ * here and its records read as they are asked for.
+ *
+ * Parameters:
+ * path - Path of the trace, or "-".
+ * s - Receives the stream.
+ * page_size - Page size to read addresses in, or 0 to read page numbers.
+ *
+ * Returns:
+ * False if the input could not be opened or is a binary trace of the wrong
+ * kind, true otherwise.
+ ******************************************************************************/
+bool trace_stream_open(const char* path, trace_stream& s, uint64_t page_size)
+{
+  trace_header header;
+  struct stat info;
+  
+  s.text.resize(2 * TRACE_STREAM_BLOCK);
+  s.held = 0;
+  s.addresses = (page_size != 0);
+  s.shift = 0;
+  while (((uint64_t) 1 << s.shift) < page_size)
+    s.shift++;
+  
+  if (strcmp(path, "-") == 0)
+  {
+    s.fd = STDIN_FILENO;
+    s.owned = false;
+    s.lines = true;
+    s.line_start = true;
+  }
+  else
+  {
+    s.fd = open(path, O_RDONLY);
+    s.owned = (s.fd >= 0);
+    
+    // Binary traces start with a header describing their records
+    if (s.fd >= 0 && trace_is_binary(path))
+    {
+      if (read(s.fd, &header, sizeof(header)) != (ssize_t) sizeof(header)
+          || fstat(s.fd, &info) != 0
+          || !trace_header_valid(header, TRACE_PAGES, info))
+      {
+        close(s.fd);
+        s.fd = -1;
+        s.owned = false;
+      }
+      else
+      {
+        s.fields = header.fields;
+        s.records = header.count;
+      }
+    }
+  }
+  
+  s.done = (s.fd < 0);
+  s.ok = (s.fd >= 0);
+  return s.ok;
+}
+
+/***************************************************************************//**
+ * trace_stream_read_lines
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Reads whole lines of a trace from standard input through the C stream,
+ * which the shell reads its commands from too, until the space given is
+ * nearly full. A line holding only TRACE_STREAM_END ends the trace and is
+ * consumed, so the shell picks up with the line after it.
+ *
+ * Parameters:
+ * s - The stream, reading standard input.
+ * space - Bytes free at the end of the text held.
+ *
+ * Returns:
+ * Number of bytes read, 0 at the end of the trace, or -1 on a read error.
+ ******************************************************************************/
+static ssize_t trace_stream_read_lines(trace_stream& s, size_t space)
+{
+  char* line;
+  size_t added = 0;
+  size_t length;
+  size_t begin;
+  size_t end;
+  
+  while (space - added > 1)
+  {
+    line = s.text.data() + s.held + added;
+    if (fgets(line, space - added, stdin) == NULL)
+    {
+      if (added == 0 && ferror(stdin))
+        return -1;
+      break;
+    }
+    length = strlen(line);
+    
+    // Only a whole line can be the terminator
+    if (s.line_start)
+    {
+      for (begin = 0; begin < length && trace_is_space(line[begin]); begin++)
+        ;
+      for (end = length; end > begin && trace_is_space(line[end - 1]); end--)
+        ;
+      if (end - begin == strlen(TRACE_STREAM_END)
+          && memcmp(line + begin, TRACE_STREAM_END, end - begin) == 0)
+      {
+        s.done = true;
+        break;
+      }
+    }
+    s.line_start = (length > 0 && line[length - 1] == '\n');
+    added += length;
+  }
+  
+  return added;
+}
+
+/***************************************************************************//**
+ * trace_stream_read_records
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Reads the next block of records from a binary trace opened as a stream.
+ * The page is the first value of each record and the write flag, if there is
+ * one, the second. A partial record is kept for the next call, and a file
+ * that ends before its header says it should counts as a read error.
+ *
+ * Parameters:
+ * s - The stream.
+ * pages - Receives the page number of each reference.
+ * writes - Receives the write flag of each reference, or is left empty if
+ * none of them is a write.
+ *
+ * Returns:
+ * Number of references read, 0 once the input is exhausted.
+ ******************************************************************************/
+static size_t trace_stream_read_records(trace_stream& s,
+  vector<long long>& pages, vector<char>& writes)
+{
+  size_t record = s.fields * sizeof(int32_t);
+  const int32_t* values;
+  ssize_t got;
+  size_t count;
+  size_t i;
+  
+  // Wait for at least one whole record
+  while (!s.done && s.records > 0 && s.held < record)
+  {
+    got = read(s.fd, s.text.data() + s.held, TRACE_STREAM_BLOCK - s.held);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+    {
+      s.done = true;
+      s.ok = false;
+    }
+    else
+    {
+      s.held += got;
+    }
+  }
+  
+  count = min((uint64_t) (s.held / record), s.records);
+  pages.resize(count);
+  writes.resize(count);
+  values = (const int32_t*) s.text.data();
+  for (i = 0; i < count; i++)
+  {
+    pages[i] = values[i * s.fields];
+    writes[i] = (s.fields > 1 && values[i * s.fields + 1] != 0);
+  }
+  trace_trim_writes(&writes, count);
+  
+  // Keep the partial record, if any, for the next read
+  memmove(s.text.data(), s.text.data() + count * record,
+          s.held - count * record);
+  s.held -= count * record;
+  s.records -= count;
+  if (s.records == 0)
+    s.done = true;
+  return count;
+}
+
+/***************************************************************************//**
+ * trace_stream_read
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Reads the next block of references from a stream: whatever complete
+ * entries are held, or else those of the next read, waiting for input to
+ * arrive. A partial entry at the end of the input read so far is kept for the
+ * next call. Reading stops at the first malformed entry, as when loading a
+ * whole trace.
+ *
+ * Parameters:
+ * s - The stream.
+ * pages - Receives the page number of each reference.
+ * writes - Receives the write flag of each reference, or is left empty if
+ * none of them is a write.
+ *
+ * Returns:
+ * Number of references read, 0 once the input is exhausted.
+ ******************************************************************************/
+size_t trace_stream_read(trace_stream& s, vector<long long>& pages,
+  vector<char>& writes)
+{
+  ssize_t got;
+  size_t end;
+  size_t count;
+  size_t i;
+  bool ok;
+  
+  if (s.fields != 0)
+    return trace_stream_read_records(s, pages, writes);
+  
+  for (;;)
+  {
+    // Complete entries end at the last separator, or at the end of input
+    end = s.held;
+    if (!s.done)
+    {
+      while (end > 0 && !trace_is_space(s.text[end - 1]))
+        end--;
+    }
+    
+    // None held yet: wait for more, growing the buffer for very long entries
+    if (end == 0 && !s.done)
+    {
+      if (s.held == s.text.size())
+        s.text.resize(2 * s.text.size());
+      if (s.lines)
+        got = trace_stream_read_lines(s, min((size_t) TRACE_STREAM_BLOCK,
+                                             s.text.size() - s.held));
+      else
+        got = read(s.fd, s.text.data() + s.held,
+                   min((size_t) TRACE_STREAM_BLOCK, s.text.size() - s.held));
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+      {
+        s.done = true;
+        s.ok = s.ok && (got == 0);
+      }
+      else
+      {
+        s.held += got;
+      }
+      continue;
+    }
+    if (end == 0)
+    {
+      pages.clear();
+      writes.clear();
+      return 0;
+    }
+    
+    count = trace_count(s.text.data(), s.text.data() + end);
+    pages.resize(count);
+    writes.resize(count);
+    if (s.addresses)
+    {
+      s.wide.resize(count);
+      count = trace_parse_address(s.text.data(), s.text.data() + end,
+                                  s.wide.data(), writes.data(), ok);
+      for (i = 0; i < count; i++)
+        pages[i] = (long long) (s.wide[i] >> s.shift);
+    }
+    else
+    {
+      s.values.resize(count);
+      count = trace_parse(s.text.data(), s.text.data() + end,
+                          s.values.data(), writes.data(), ok);
+      for (i = 0; i < count; i++)
+        pages[i] = s.values[i];
+    }
+    pages.resize(count);
+    trace_trim_writes(&writes, count);
+    
+    // Keep the unparsed tail, or drop everything after a malformed entry
+    memmove(s.text.data(), s.text.data() + end, s.held - end);
+    s.held -= end;
+    if (!ok)
+    {
+      s.ok = false;
+      s.done = true;
+      s.held = 0;
+    }
+    
+    if (count > 0 || s.done)
+      return count;
+  }
+}
+
+/***************************************************************************//**
+ * trace_map_positions
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Maps the entries for a range of positions of a file holding one unsigned
+ * int per position. The mapping has to start on a page boundary, so it may
+ * begin a little before the first position asked for.
+ *
+ * Parameters:
+ * fd - The file.
+ * first - First position to map.
+ * last - One past the last position to map.
+ * prot - Protection of the mapping.
+ * map - Receives the start of the mapping, or MAP_FAILED.
+ * map_size - Receives the length of the mapping.
+ *
+ * Returns:
+ * The entry of position first within the mapping.
+ ******************************************************************************/
+static unsigned int* trace_map_positions(int fd, size_t first, size_t last,
+  int prot, void*& map, size_t& map_size)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t begin = first * sizeof(unsigned int) / page * page;
+  
+  map_size = last * sizeof(unsigned int) - begin;
+  map = mmap(NULL, map_size, prot, MAP_SHARED, fd, begin);
+  if (map == MAP_FAILED)
+    return NULL;
+  return (unsigned int*) ((char*) map + first * sizeof(unsigned int) - begin);
+}
+
+/***************************************************************************//**
+ * trace_next_use::~trace_next_use
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Releases the window and the file, which disappears with its descriptor.
+ ******************************************************************************/
+trace_next_use::~trace_next_use()
+{
+  if (map != NULL)
+    munmap(map, map_size);
+  if (fd >= 0)
+    close(fd);
+}
+
+/***************************************************************************//**
+ * trace_next_use::slide
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Maps the window holding a position, in place of the previous one. Windows
+ * are aligned to multiples of the window size, so reading positions in order
+ * maps each part of the file once. The part left behind is of no further use
+ * and the kernel is told so.
+ *
+ * Parameters:
+ * i - Position to be read next.
+ *
+ * Returns:
+ * False if the window could not be mapped, true otherwise.
+ ******************************************************************************/
+bool trace_next_use::slide(size_t i)
+{
+  if (map != NULL)
+  {
+    munmap(map, map_size);
+    posix_fadvise(fd, first * sizeof(unsigned int),
+                  (last - first) * sizeof(unsigned int), POSIX_FADV_DONTNEED);
+  }
+  
+  first = i / window * window;
+  last = min(first + window, count);
+  view = trace_map_positions(fd, first, last, PROT_READ, map, map_size);
+  if (view == NULL)
+  {
+    map = NULL;
+    first = last = 0;
+    return false;
+  }
+  madvise(map, map_size, MADV_SEQUENTIAL);
+  return true;
+}
+
+/***************************************************************************//**
+ * trace_next_use_build
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Finds the next use of every reference of a page trace with one backward
+ * pass, writing the results to an unlinked temporary file through a window
+ * mapped over one part of it at a time. Only the position of the latest
+ * reference to each page is held in memory, in a table for a remapped trace
+ * or a hash map for one holding page numbers.
+ *
+ * Parameters:
+ * t - The trace.
+ * window - Number of positions to map at a time.
+ * n - Receives the next uses.
+ *
+ * Returns:
+ * False if the temporary file could not be created or mapped.
+ ******************************************************************************/
+bool trace_next_use_build(const trace& t, size_t window, trace_next_use& n)
+{
+  vector<unsigned int> later(t.distinct(), t.size());
+  unordered_map<int, unsigned int> raw;         // if not remapped
+  const char* dir = getenv("TMPDIR");
+  string path;
+  unsigned int* view;
+  void* map;
+  size_t map_size;
+  size_t first;
+  size_t last;
+  size_t i;
+  
+  path = string(dir != NULL && *dir != '\0' ? dir : TRACE_TMP_DIR)
+         + "/msim-next-XXXXXX";
+  n.fd = mkstemp(&path[0]);
+  if (n.fd < 0)
+    return false;
+  unlink(path.c_str());
+  
+  n.count = t.size();
+  n.window = max(window, (size_t) 1);
+  if (ftruncate(n.fd, n.count * sizeof(unsigned int)) != 0)
+    return false;
+  
+  // Last window first, each filled from its end
+  for (last = n.count; last > 0; last = first)
+  {
+    first = (last - 1) / n.window * n.window;
+    view = trace_map_positions(n.fd, first, last, PROT_READ | PROT_WRITE, map,
+                               map_size);
+    if (view == NULL)
+      return false;
+    for (i = last; i-- > first; )
+    {
+      unsigned int& latest = t.distinct() != 0 ? later[t[i]]
+                             : raw.emplace(t[i], t.size()).first->second;
+      
+      view[i - first] = latest;
+      latest = i;
+    }
+    munmap(map, map_size);
+  }
+  return true;
+}
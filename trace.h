@@ -0,0 +1,220 @@
+/***************************************************************************//**
+ * File:
+ * trace.h
+ *
+ * Author:
+ * Daniel Andrus
+ * 
+ * Description:
+ * Contains function headers for loading reference traces used by the
+ * simulation commands.
+ ******************************************************************************/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cerrno>
+
+using namespace std;
+
+// Binary trace identification
+#define TRACE_MAGIC "TRCB"
+#define TRACE_VERSION 1
+
+// Kinds of binary trace
+#define TRACE_PAGES 1       // int32 page reference per record, then an
+                            // optional int32 write flag
+#define TRACE_PROCS 2       // int32 start, length, priority per record
+
+/*******************************************************************************
+ * Header at the start of every binary trace. It is followed directly by count
+ * records of fields int32 values each, in native byte order, so the payload
+ * can be used in place once the file is mapped. Page traces have 1 field, or
+ * 2 with write flags; process traces have 3.
+ ******************************************************************************/
+struct trace_header
+{
+  char magic[4];
+  uint16_t version;
+  uint16_t kind;
+  uint32_t fields;
+  uint32_t reserved;
+  uint64_t count;
+};
+
+/*******************************************************************************
+ * A loaded trace. Text traces are parsed into storage, while binary traces are
+ * mapped from disk and read in place; either way data points at the values.
+ * For page traces every value is one reference, so the trace can be indexed
+ * like the reference string it is, and writes marks the references that are
+ * writes if the trace records them.
+ *
+ * Once remapped, the values are dense page ids 0 to distinct() - 1 instead of
+ * the page numbers themselves, and pages holds the page number of each id.
+ ******************************************************************************/
+struct trace
+{
+  const int* data;
+  size_t count;
+  vector<int> storage;
+  void* map;
+  size_t map_size;
+  vector<long long> pages;      // page number of each dense id, if remapped
+  vector<char> writes;          // 1 for each write, empty if there are none
+
+  trace() : data(NULL), count(0), map(NULL), map_size(0) {}
+  ~trace();
+  int operator[](size_t i) const { return data[i]; }
+  size_t size() const { return count; }
+  size_t distinct() const { return pages.size(); }
+  bool has_writes() const { return !writes.empty(); }
+  bool write(size_t i) const { return !writes.empty() && writes[i]; }
+  long long page(int id) const { return pages.empty() ? id : pages[id]; }
+
+private:
+  trace(const trace&);
+  trace& operator=(const trace&);
+};
+
+// Bytes read from a streamed trace at a time
+#define TRACE_STREAM_BLOCK (1 << 20)
+
+// Line that ends a trace read from standard input, handing the rest of the
+// input back to the shell
+#define TRACE_STREAM_END "end"
+
+/*******************************************************************************
+ * A page trace read a block at a time as it arrives, from standard input
+ * ("-"), a pipe or a file, for simulations that never look ahead. Each read
+ * parses the input up to its last complete entry and keeps the rest for the
+ * next one. With a nonzero shift the entries are addresses, turned into page
+ * numbers as they are read. A binary trace file is read the same way, whole
+ * records at a time, so it need not be mapped. Standard input is shared with
+ * the shell, so it is read through the C stream a line at a time and only up
+ * to a TRACE_STREAM_END line.
+ ******************************************************************************/
+struct trace_stream
+{
+  int fd;
+  bool owned;                   // whether fd is closed with the stream
+  bool done;                    // end of input reached
+  bool ok;                      // no malformed entry or read error so far
+  unsigned int shift;
+  bool addresses;
+  bool lines;                   // standard input, read up to TRACE_STREAM_END
+  bool line_start;              // next line read starts a new entry line
+  unsigned int fields;          // values per record if binary, 0 for text
+  uint64_t records;             // records of a binary trace not yet read
+  vector<char> text;            // input read but not yet parsed
+  size_t held;                  // bytes of text in use
+  vector<int> values;
+  vector<uint64_t> wide;
+
+  trace_stream() : fd(-1), owned(false), done(true), ok(true), shift(0),
+    addresses(false), lines(false), line_start(true), fields(0),
+    records(0), held(0) {}
+  ~trace_stream();
+
+private:
+  trace_stream(const trace_stream&);
+  trace_stream& operator=(const trace_stream&);
+};
+
+/*******************************************************************************
+ * Next use of every reference of a trace, the position of the next reference
+ * to the same page or the length of the trace if there is none, kept in an
+ * unlinked temporary file instead of memory. Only a window of the file is
+ * mapped at a time and it is slid along as positions are read, so memory use
+ * is bounded by the window however long the trace is.
+ ******************************************************************************/
+struct trace_next_use
+{
+  int fd;
+  size_t count;
+  size_t window;                // positions mapped at a time
+  void* map;
+  size_t map_size;
+  const unsigned int* view;     // next use of position first
+  size_t first;                 // positions first to last - 1 are mapped
+  size_t last;
+
+  trace_next_use() : fd(-1), count(0), window(0), map(NULL), map_size(0),
+    view(NULL), first(0), last(0) {}
+  ~trace_next_use();
+  bool read(size_t i, unsigned int& next)
+  {
+    if ((i < first || i >= last) && !slide(i))
+      return false;
+    next = view[i - first];
+    return true;
+  }
+  bool slide(size_t i);
+
+private:
+  trace_next_use(const trace_next_use&);
+  trace_next_use& operator=(const trace_next_use&);
+};
+
+/*******************************************************************************
+ * Pages of multi-process traces are keyed by process id and page number packed
+ * into one 64-bit value, the process id in the high half, so that they remap
+ * and look up like any other page and the pages of a process sort together.
+ ******************************************************************************/
+inline long long trace_key(int pid, int page)
+{
+  return (long long) ((uint64_t) (uint32_t) pid << 32 | (uint32_t) page);
+}
+
+inline int trace_key_pid(long long key)
+{
+  return (int) (uint32_t) ((uint64_t) key >> 32);
+}
+
+inline int trace_key_page(long long key)
+{
+  return (int) (uint32_t) key;
+}
+
+bool trace_open(const char* path, trace& t, unsigned int kind);
+bool trace_load(const char* path, vector<int>& refs,
+  vector<char>* writes = NULL);
+bool trace_load_addresses(const char* path, vector<uint64_t>& addresses,
+  vector<char>& writes);
+bool trace_open_addresses(const char* path, trace& t, uint64_t page_size);
+bool trace_open_processes(const char* path, trace& t);
+void trace_page_numbers(uint64_t* addresses, size_t count, unsigned int shift);
+bool trace_is_binary(const char* path);
+bool trace_is_stream(const char* path);
+bool trace_next_use_build(const trace& t, size_t window, trace_next_use& n);
+bool trace_stream_open(const char* path, trace_stream& s, uint64_t page_size);
+size_t trace_stream_read(trace_stream& s, vector<long long>& pages,
+  vector<char>& writes);
+void trace_remap(trace& t);
+bool trace_write(const char* path, unsigned int kind, const int* values,
+  size_t count, unsigned int fields);
+
+size_t trace_count(const char* begin, const char* end);
+size_t trace_parse(const char* begin, const char* end, int* refs,
+  char* writes, bool& ok);
+size_t trace_parse_process(const char* begin, const char* end,
+  uint64_t* keys, char* writes, bool& ok);
+size_t trace_parse_address(const char* begin, const char* end,
+  uint64_t* addresses, char* writes, bool& ok);
+
+#endif